@@ -0,0 +1,235 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// Times the simulation hot loop (kitten and toy updates, world transforms and
+// collision finding) on the level given on the command line for several
+// colony sizes:
+//
+//   kitten_keeper_bench [--ticks=N] [--warmup=N] [--sizes=10,100,...]
+//                       [--toy-spacing=PX] [--seed=N] [--threads=N]
+//                       [--corpse-time=SEC] [map.ldl]
+//
+// Toys are laid out on a grid with the given spacing, cycling through the
+// toy types; 0 places no toy. The seed defaults to 1 so that runs compare,
+// and the corpse time to 1 second so that dead kittens are retired within
+// the run.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "game.h"
+#include "level.h"
+#include "main_state.h"
+
+
+namespace {
+
+std::atomic<uint64> allocCount(0);
+
+struct BenchConfig {
+	unsigned              ticks      = 600;
+	unsigned              warmup     = 60;
+	float                 toySpacing = 192;
+	std::vector<unsigned> sizes      = { 10, 100, 1000, 10000 };
+};
+
+struct BenchResult {
+	unsigned nKittens;
+	double   avgKittens;
+	double   nsPerTick;
+	double   nsPerKittenTick;
+	double   allocsPerTick;
+	int      finalKittens;
+};
+
+void parseSizes(const char* arg, std::vector<unsigned>& sizes) {
+	sizes.clear();
+	while(*arg) {
+		char* end;
+		unsigned size = std::strtoul(arg, &end, 10);
+		if(end == arg)
+			break;
+		if(size)
+			sizes.push_back(size);
+		arg = (*end == ',')? end + 1: end;
+	}
+}
+
+unsigned nKittens(MainState* state) {
+	return state->_spawnCount - state->_deathCount;
+}
+
+void placeToys(MainState* state, float spacing) {
+	if(spacing <= 0)
+		return;
+
+	EntityRef models[] = {
+	    state->_foodModel,
+	    state->_toyModel,
+	    state->_litterModel,
+	    state->_pillModel,
+	    state->_basketModel,
+	};
+	const unsigned nModels = sizeof(models) / sizeof(*models);
+
+	TileLayerCSP tileLayer = state->_level->tileMap()->tileLayer(0);
+	Vector2 levelSize(tileLayer->widthInTiles()  * TILE_SIZE,
+	                  tileLayer->heightInTiles() * TILE_SIZE);
+
+	unsigned index = 0;
+	for(float y = spacing / 2; y < levelSize(1); y += spacing) {
+		for(float x = spacing / 2; x < levelSize(0); x += spacing) {
+			if(state->placeToy(models[index % nModels], Vector2(x, y)).isValid())
+				++index;
+		}
+	}
+}
+
+void simulateTick(MainState* state) {
+	state->_entities.setPrevWorldTransforms();
+	state->_kittens.update();
+	state->_toys.update();
+	++state->_colonyTicks;
+	state->retireCorpses();
+	state->_entities.updateWorldTransforms();
+	state->_collisions.findCollisions();
+	state->checkHitEvents();
+}
+
+BenchResult runScenario(MainState* state, const BenchConfig& config, unsigned size) {
+	typedef std::chrono::steady_clock Clock;
+
+	state->startGame();
+	placeToys(state, config.toySpacing);
+	while(nKittens(state) < size)
+		state->spawnKitten();
+	state->_entities.updateWorldTransforms();
+	state->_collisions.findCollisions();
+
+	for(unsigned ti = 0; ti < config.warmup; ++ti)
+		simulateTick(state);
+
+	uint64 kittenTicks = 0;
+	uint64 ns          = 0;
+	uint64 allocs      = 0;
+	for(unsigned ti = 0; ti < config.ticks; ++ti) {
+		kittenTicks += nKittens(state);
+
+		uint64 allocStart = allocCount.load(std::memory_order_relaxed);
+		Clock::time_point start = Clock::now();
+
+		simulateTick(state);
+
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		          Clock::now() - start).count();
+		allocs += allocCount.load(std::memory_order_relaxed) - allocStart;
+	}
+
+	double ticks = std::max(config.ticks, 1u);
+	BenchResult result;
+	result.nKittens        = size;
+	result.avgKittens      = kittenTicks / ticks;
+	result.nsPerTick       = ns / ticks;
+	result.nsPerKittenTick = kittenTicks? double(ns) / kittenTicks: 0;
+	result.allocsPerTick   = allocs / ticks;
+	result.finalKittens    = nKittens(state);
+	return result;
+}
+
+}
+
+
+// Counts every scalar new of the process, lair's included; allocs/tick is
+// the number done while simulateTick() runs. Array new goes through this
+// too, direct malloc calls do not.
+void* operator new(std::size_t size) {
+	allocCount.fetch_add(1, std::memory_order_relaxed);
+	if(void* p = std::malloc(size? size: 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+
+int main(int argc, char** argv) {
+	BenchConfig config;
+
+	// Keep the arguments understood by GameConfig (level, --seed, ...) and
+	// always run headless.
+	std::vector<char*> args;
+	args.push_back(argv[0]);
+	args.push_back(const_cast<char*>("--headless"));
+	bool hasSeed       = false;
+	bool hasCorpseTime = false;
+	for(int ai = 1; ai < argc; ++ai) {
+		const char* arg = argv[ai];
+		if(std::strncmp(arg, "--ticks=", 8) == 0)
+			config.ticks = std::strtoul(arg + 8, nullptr, 10);
+		else if(std::strncmp(arg, "--warmup=", 9) == 0)
+			config.warmup = std::strtoul(arg + 9, nullptr, 10);
+		else if(std::strncmp(arg, "--sizes=", 8) == 0)
+			parseSizes(arg + 8, config.sizes);
+		else if(std::strncmp(arg, "--toy-spacing=", 14) == 0)
+			config.toySpacing = std::strtof(arg + 14, nullptr);
+		else {
+			hasSeed       = hasSeed || std::strncmp(arg, "--seed=", 7) == 0;
+			hasCorpseTime = hasCorpseTime || std::strncmp(arg, "--corpse-time=", 14) == 0;
+			args.push_back(argv[ai]);
+		}
+	}
+	if(!hasSeed)
+		args.push_back(const_cast<char*>("--seed=1"));
+	if(!hasCorpseTime)
+		args.push_back(const_cast<char*>("--corpse-time=1"));
+	args.push_back(nullptr);
+
+	Game game(int(args.size() - 1), args.data());
+	game.initialize();
+
+	MainState* state = game.mainState();
+
+	std::printf("%8s %10s %14s %16s %14s %8s\n",
+	            "kittens", "avg", "ns/tick", "ns/kitten/tick", "allocs/tick", "final");
+	for(unsigned size: config.sizes) {
+		BenchResult r = runScenario(state, config, size);
+		std::printf("%8u %10.1f %14.0f %16.1f %14.1f %8d\n",
+		            r.nKittens, r.avgKittens, r.nsPerTick, r.nsPerKittenTick,
+		            r.allocsPerTick, r.finalKittens);
+		std::fflush(stdout);
+	}
+
+	game.shutdown();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_COMMAND_H_
+#define KITTEN_KEEPER_COMMAND_H_
+
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include <lair/ec/entity.h>
+
+
+using namespace lair;
+
+
+class MainState;
+
+// self is the entity the command runs for, if any. Programs of a trigger
+// (on_enter, on_exit) get the kitten that entered or left it, the trigger
+// being the one that holds the program.
+typedef int (*Command)(MainState* state, EntityRef self, int argc, const char** argv);
+typedef std::unordered_map<std::string, Command> CommandMap;
+
+// A command string split in calls, with the commands looked up and the
+// arguments tokenized once. See MainState::compile().
+struct CommandProgram {
+	struct Call {
+		Command  command; // nullptr if unknown.
+		unsigned firstArg;
+		unsigned argc;
+	};
+
+	String                args;       // Each argument is followed by '\0'.
+	std::vector<unsigned> argOffsets; // Start of each argument in args.
+	std::vector<Call>     calls;
+};
+typedef std::shared_ptr<const CommandProgram> CommandProgramSP;
+
+struct CommandExpr {
+	String           command;
+	EntityRef        self;
+	// If set, command is ignored and this call of program is run instead.
+	CommandProgramSP program;
+	unsigned         call;
+};
+typedef std::deque<CommandExpr> CommandList;
+
+
+#endif
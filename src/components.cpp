@@ -19,7 +19,12 @@
  */
 
 
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
 #include "main_state.h"
+#include "game_view.h"
 #include "level.h"
 
 #include "components.h"
@@ -27,8 +32,7 @@
 
 TriggerComponent::TriggerComponent(Manager* manager, _Entity* entity)
     : Component(manager, entity)
-    , prevInside(false)
-    , inside(false)
+    , occupancyId(0)
 {
 }
 
@@ -71,30 +75,57 @@ TriggerComponentManager::TriggerComponentManager()
 
 #define KIT_ANIM_LEN 0.4f
 
+// Kittens that cannot change state for a while are only updated every
+// KIT_LOD_LONG or KIT_LOD_SHORT ticks.
+#define KIT_LOD_LONG  16
+#define KIT_LOD_SHORT 4
+
+// Below this, splitting the update between threads costs more than it saves.
+#define KIT_MIN_PARALLEL 256
+
 KittenComponent::KittenComponent(Manager* manager, _Entity* entity) :
     Component(manager, entity),
-    sick(0),
-    tired(2),
-    bored(2),
-    hungry(2),
-    needy(2),
+    statManager(manager),
+    statRow(manager->allocStatRow()),
     s(SITTING),
     t(0),
     dst(0,0),
+    seekType(TOY_TYPE_COUNT),
     anim(ANIM_IDLE),
-    animTime(0)
+    animTime(0),
+    pos(0, 0),
+    tileIndex(10),
+    bubble(BUBBLE_NONE),
+    bubbleIntensity(0),
+    nextPos(0, 0),
+    nextToy(KittenComponentManager::KEEP_TOY),
+    lodSkip(0),
+    lodSkipped(0),
+    toy(),
+    toyPlacement(0),
+    occupancyId(0)
 {
+	sick()   = 0;
+	tired()  = 2;
+	bored()  = 2;
+	hungry() = 2;
+	needy()  = 2;
 }
 
 
 const PropertyList& KittenComponent::properties() {
 	static PropertyList props;
 	if(props.nProperties() == 0) {
-		props.addProperty("sick",   &KittenComponent::sick);
-		props.addProperty("tired",  &KittenComponent::tired);
-		props.addProperty("bored",  &KittenComponent::bored);
-		props.addProperty("hungry", &KittenComponent::hungry);
-		props.addProperty("needy",  &KittenComponent::needy);
+		props.addProperty("sick",   &KittenComponent::statProperty<STAT_SICK>,
+		                            &KittenComponent::setStatProperty<STAT_SICK>);
+		props.addProperty("tired",  &KittenComponent::statProperty<STAT_TIRED>,
+		                            &KittenComponent::setStatProperty<STAT_TIRED>);
+		props.addProperty("bored",  &KittenComponent::statProperty<STAT_BORED>,
+		                            &KittenComponent::setStatProperty<STAT_BORED>);
+		props.addProperty("hungry", &KittenComponent::statProperty<STAT_HUNGRY>,
+		                            &KittenComponent::setStatProperty<STAT_HUNGRY>);
+		props.addProperty("needy",  &KittenComponent::statProperty<STAT_NEEDY>,
+		                            &KittenComponent::setStatProperty<STAT_NEEDY>);
 		props.addProperty("status", &KittenComponent::s);
 		props.addProperty("t",      &KittenComponent::t);
 		props.addProperty("dst",    &KittenComponent::dst);
@@ -105,11 +136,103 @@ const PropertyList& KittenComponent::properties() {
 
 KittenComponentManager::KittenComponentManager(MainState* ms)
     : DenseComponentManager<KittenComponent>("kitten", 128),
-    _ms(ms)
+    _ms(ms),
+    _nStatRows(0),
+    _nChunks(0)
 {
 }
 
 
+void KittenComponentManager::updateGrids() {
+	AlignedBox2 bounds = _ms->_level->bounds();
+
+	_kittenGrid.setBounds(bounds, TILE_SIZE);
+	_kittenGrid.clear();
+	_kittenBoxes.resize(nComponents());
+	for(unsigned k = 0 ; k < nComponents() ; ++k) {
+		EntityRef entity = _components[k].entity();
+		_components[k].pos = entity.position2();
+		CollisionComponent* coll = _ms->_collisions.get(entity);
+		if(!entity.isEnabledRec() || !coll)
+			continue;
+
+		// Dead kittens are still in the way of the others.
+		_kittenBoxes[k] = coll->shapes()[0].transformed(entity.worldTransform().matrix()).asAlignedBox();
+		_kittenGrid.insert(k, _kittenBoxes[k]);
+	}
+	_kittenGrid.build();
+
+	for(SpatialGrid& grid: _toyGrids) {
+		grid.setBounds(bounds, TILE_SIZE);
+		grid.clear();
+	}
+	// Ids are toy indices, see ToyComponentManager::toyAt().
+	for(unsigned ti = 0; ti < _ms->_toys.nComponents(); ++ti) {
+		ToyComponent& toy = _ms->_toys.toyAt(ti);
+		EntityRef entity = toy.entity();
+		CollisionComponent* coll = _ms->_collisions.get(entity);
+		if(toy.state == ToyComponent::PLACED && entity.isEnabledRec() && coll) {
+			AlignedBox2 box = coll->shapes()[0].transformed(entity.worldTransform().matrix()).asAlignedBox();
+			_toyGrids[toy.type].insert(ti, box, entity.position2());
+		}
+	}
+	for(SpatialGrid& grid: _toyGrids)
+		grid.build();
+}
+
+
+void KittenComponentManager::updateStats() {
+	unsigned nKittens = nComponents();
+	_active.clear();
+	_activeMask.resize(nKittens);
+	for(unsigned k = 0 ; k < nKittens ; ++k) {
+		KittenComponent& kitten = _components[k];
+		_activeMask(k) = false;
+		if(!kitten.entity().isEnabledRec() || !kitten.isEnabled())
+			continue;
+
+		// Kittens on a toy that was picked up since get off it.
+		bool lostToy = kitten.toy.isValid() && !hasToy(kitten);
+		if(kitten.lodSkip && !lostToy) {
+			--kitten.lodSkip;
+			++kitten.lodSkipped;
+			continue;
+		}
+		kitten.lodSkip = 0;
+		if(kitten.lodSkipped)
+			wakeKitten(kitten);
+		if(lostToy) {
+			releaseToy(kitten);
+			kitten.s = SITTING;
+		}
+		_active.push_back(k);
+		_activeMask(k) = true;
+	}
+
+	// Basal metabolism of the active kittens. Once sick, it only gets
+	// worse; the onset is random and done per kitten. Adding 0 leaves the
+	// others untouched.
+	auto stats = _stats.topRows(nKittens);
+	auto active = _activeMask.cast<float>();
+	stats.col(STAT_SICK)    = _activeMask.select(stats.col(STAT_SICK) * 1.003f,
+	                                             stats.col(STAT_SICK));
+	stats.col(STAT_TIRED)  += active * KIT_FPT;
+	stats.col(STAT_BORED)  += active * KIT_BPT;
+	stats.col(STAT_HUNGRY) += active * KIT_HPT;
+	stats.col(STAT_NEEDY)  += active * KIT_NPT;
+
+	_statLevels = (stats > KIT_LOW).cast<uint8_t>()
+	            + (stats > KIT_BAD).cast<uint8_t>()
+	            + (stats > KIT_MAX).cast<uint8_t>();
+}
+
+unsigned KittenComponentManager::allocStatRow() {
+	if(_nStatRows == unsigned(_stats.rows()))
+		_stats.conservativeResize(std::max(2 * _nStatRows, 128u), Eigen::NoChange);
+	return _nStatRows++;
+}
+
+
 void KittenComponentManager::setBubble(EntityRef kitten, BubbleType bubbleType, float intensity) {
 	EntityRef bubble = kitten.firstChild();
 	if(!bubble.isValid()) {
@@ -135,40 +258,34 @@ void KittenComponentManager::setBubble(EntityRef kitten, BubbleType bubbleType,
 }
 
 
+void KittenComponentManager::showBubble(KittenComponent& kitten, BubbleType bubbleType, float intensity) {
+	kitten.bubble          = bubbleType;
+	kitten.bubbleIntensity = intensity;
+}
+
+
 void KittenComponentManager::setAnim(KittenComponent& kitten, KittenAnim anim) {
 	if(kitten.anim == anim)
 		return;
 
-	SpriteComponent* sprite = _ms->_sprites.get(kitten.entity());
-	if(!sprite) {
-		dbgLogger.error("Kitten without sprite ?");
-		return;
-	}
-
 	kitten.anim = anim;
 	kitten.animTime = 0;
 	switch(anim) {
-	case ANIM_IDLE:  sprite->setTileIndex(10); break;
-	case ANIM_UP:    sprite->setTileIndex(6); break;
-	case ANIM_RIGHT: sprite->setTileIndex(0); break;
-	case ANIM_DOWN:  sprite->setTileIndex(4); break;
-	case ANIM_LEFT:  sprite->setTileIndex(2); break;
-	case ANIM_SLEEP: sprite->setTileIndex(8); break;
-	case ANIM_PLAY:  sprite->setTileIndex(9); break;
-	case ANIM_DEAD:  sprite->setTileIndex(11); break;
+	case ANIM_IDLE:  kitten.tileIndex = 10; break;
+	case ANIM_UP:    kitten.tileIndex = 6; break;
+	case ANIM_RIGHT: kitten.tileIndex = 0; break;
+	case ANIM_DOWN:  kitten.tileIndex = 4; break;
+	case ANIM_LEFT:  kitten.tileIndex = 2; break;
+	case ANIM_SLEEP: kitten.tileIndex = 8; break;
+	case ANIM_PLAY:  kitten.tileIndex = 9; break;
+	case ANIM_DEAD:  kitten.tileIndex = 11; break;
 	}
 }
 
 void KittenComponentManager::updateAnim(KittenComponent& kitten) {
-	SpriteComponent* sprite = _ms->_sprites.get(kitten.entity());
-	if(!sprite) {
-		dbgLogger.error("Kitten without sprite ?");
-		return;
-	}
-
-	if(sprite->tileIndex() < 8 && kitten.animTime >= KIT_ANIM_LEN) {
+	if(kitten.tileIndex < 8 && kitten.animTime >= KIT_ANIM_LEN) {
 		kitten.animTime -= KIT_ANIM_LEN;
-		sprite->setTileIndex(sprite->tileIndex() ^ 1);
+		kitten.tileIndex ^= 1;
 	}
 
 	kitten.animTime += TICK_LENGTH_IN_SEC;
@@ -180,23 +297,52 @@ void KittenComponentManager::seek(KittenComponent& k, ToyType tt, bool now)
 		return;
 
 	float range = now ? 800 : 200 ;
-	for (ToyComponent& t: _ms->_toys)
-	{
-		float dist = (k.entity().position2() - t.entity().position2()).norm();
-		if (t.type == tt && dist < range && t.state == t.PLACED) {
+	Vector2 pos = k.pos;
+	const FlowField& field = _ms->_toys.flowField(tt);
+	Vector2i cell = field.cell(pos);
+	if (field.distance(cell) != FlowField::UNREACHABLE) {
+		const Vector2& target = field.target(cell);
+		if ((target - pos).norm() < range) {
 			k.s = WALKING;
-			k.dst = t.entity().position2();
-			range = dist;
+			k.dst = target;
+			k.seekType = tt;
 		}
+		return;
 	}
+
+	// No path, walk in a straight line and hope for the best.
+	const SpatialGrid::Item* toy = _toyGrids[tt].nearest(pos, range);
+	if (toy) {
+		k.s = WALKING;
+		k.dst = toy->point;
+		k.seekType = TOY_TYPE_COUNT;
+	}
+}
+
+Vector2 KittenComponentManager::walkGoal(KittenComponent& kitten) {
+	if (kitten.seekType == TOY_TYPE_COUNT)
+		return kitten.dst;
+
+	const FlowField& field = _ms->_toys.flowField(kitten.seekType);
+	Vector2i cell = field.cell(kitten.pos);
+	unsigned dist = field.distance(cell);
+	if (dist == FlowField::UNREACHABLE)
+		return kitten.dst;
+
+	// Follow the closest toy, even if it moved since we started walking.
+	kitten.dst = field.target(cell);
+	if (dist == 0)
+		return kitten.dst;
+	// Kittens are centered on their position, see kitten_model.
+	return field.cellCenter(field.next(cell));
 }
 
-Vector2 KittenComponentManager::findRandomDest(const Vector2& p, float radius) {
+Vector2 KittenComponentManager::findRandomDest(Rng& rng, const Vector2& p, float radius) {
 	int tryCount = 0;
 	AlignedBox2 box;
 	Vector2 dest;
 	do {
-		dest = p + Vector2::Random() * radius;
+		dest = p + rng.vector2() * radius;
 		box = AlignedBox2(dest - Vector2(16, 32), dest + Vector2(16, 0));
 		++tryCount;
 	} while(tryCount < 10 && _ms->_level->hitTest(box));
@@ -204,6 +350,14 @@ Vector2 KittenComponentManager::findRandomDest(const Vector2& p, float radius) {
 	return (tryCount < 10)? dest: p;
 }
 
+void KittenComponentManager::wander(KittenComponent& kitten) {
+	kitten.bored() += KIT_BPT;
+	kitten.s = WALKING;
+	kitten.bypass = BYPASS_NONE;
+	kitten.dst = findRandomDest(kitten.rng, kitten.pos, 400);
+	kitten.seekType = TOY_TYPE_COUNT;
+}
+
 float KittenComponentManager::urgency(float x) {
 	return (x - KIT_LOW + (x > KIT_BAD ? KIT_LOW : 0) ) / 100;
 }
@@ -217,275 +371,568 @@ float KittenComponentManager::urgency(float x) {
  */
 
 void KittenComponentManager::update() {
-	// Some garbage collection...
+	beginUpdate();
+	runUpdate();
+	endUpdate();
+}
+
+void KittenComponentManager::compact() {
+	// Keeps the order of the components.
 	compactArray();
 
-	int nDir = 8;
-	Eigen::Rotation2D<float> rotL( M_PI / double(nDir));
-	Eigen::Rotation2D<float> rotR(-M_PI / double(nDir));
+	// Bring the stats along, so that row k is the component k again.
+	unsigned nKittens = nComponents();
+	StatArray stats(_stats.rows(), int(STAT_COUNT));
+	for(unsigned k = 0; k < nKittens; ++k) {
+		stats.row(k) = _stats.row(_components[k].statRow);
+		_components[k].statRow = k;
+	}
+	_stats.swap(stats);
+	_nStatRows = nKittens;
+}
 
-	for(unsigned k = 0 ; k < nComponents() ; ++k) {
-		KittenComponent& kitten = _components[k];
-		EntityRef entity = kitten.entity();
+void KittenComponentManager::checkCompact() const {
+#ifndef NDEBUG
+	lairAssert(_nStatRows == nComponents());
+	for(unsigned k = 0; k < nComponents(); ++k) {
+		lairAssert(_components[k].entity().isValid());
+		lairAssert(_components[k].statRow == k);
+	}
+#endif
+}
 
-		if(!entity.isEnabledRec() || !kitten.isEnabled())
-			continue;
+void KittenComponentManager::beginUpdate() {
+	checkCompact();
+	_ms->_toys.checkCompact();
+
+	_ms->_toys.updateFlowFields();
+	updateGrids();
+	updateStats();
+
+	// Kittens only write to their own component and to the event list of
+	// their chunk, everything else is read-only until the serial part.
+	unsigned nActive = _active.size();
+	_nChunks = (nActive < KIT_MIN_PARALLEL)? 1: _ms->_workers.nThreads() * 4;
+	if(_events.size() < _nChunks)
+		_events.resize(_nChunks);
+	for(EventList& events: _events)
+		events.clear();
+}
 
-		// Basal metabolism.
-		if (kitten.sick)
-			kitten.sick += kitten.sick * 0.003;
-		else if (rand()%(180*TICKS_PER_SEC) == 0)
-			kitten.sick = KIT_LOW;
+void KittenComponentManager::runUpdate() {
+	_ms->_workers.run(_active.size(), _nChunks, [this](unsigned begin, unsigned end, unsigned chunk) {
+		for(unsigned ai = begin; ai < end; ++ai) {
+			updateKitten(ai, _events[chunk]);
+			scheduleKitten(ai);
+		}
+	});
+}
 
-		kitten.tired  += KIT_FPT;
-		kitten.bored  += KIT_BPT;
-		kitten.hungry += KIT_HPT;
-		kitten.needy  += KIT_NPT;
+void KittenComponentManager::endUpdate() {
+	// Chunks are contiguous, so this is the order of the kittens.
+	for(unsigned k: _active)
+		applyKitten(_components[k]);
+	for(unsigned ci = 0; ci < _nChunks; ++ci) {
+		for(const Event& event: _events[ci])
+			applyEvent(event);
+	}
+	checkToyUsers();
+}
 
-		// Animation setting.
-		switch(kitten.s) {
+void KittenComponentManager::updateKitten(unsigned ai, EventList& events) {
+	const int nDir = 8;
+	static const Eigen::Rotation2D<float> rotL( M_PI / double(nDir));
+	static const Eigen::Rotation2D<float> rotR(-M_PI / double(nDir));
+
+	unsigned k = _active[ai];
+	KittenComponent& kitten = _components[k];
+	const Vector2 pos = kitten.pos;
+	auto level = _statLevels.row(k);
+
+	// Basal metabolism is done by updateStats().
+	if (!kitten.sick() && kitten.rng.oneIn(180*TICKS_PER_SEC))
+		kitten.sick() = KIT_LOW;
+
+	Vector2 goal = (kitten.s == WALKING)? walkGoal(kitten): kitten.dst;
+	kitten.nextToy = KEEP_TOY;
+
+	// Animation setting.
+	switch(kitten.s) {
+	case SITTING:
+	case EATING:
+	case PEEING:
+		setAnim(kitten, ANIM_IDLE);
+		break;
+	case WALKING: {
+		Vector2 v = goal - pos;
+		int axis;
+		v.cwiseAbs().maxCoeff(&axis);
+		if(axis == 0 && v(axis) <  0) setAnim(kitten, ANIM_LEFT);
+		if(axis == 0 && v(axis) >= 0) setAnim(kitten, ANIM_RIGHT);
+		if(axis == 1 && v(axis) <  0) setAnim(kitten, ANIM_DOWN);
+		if(axis == 1 && v(axis) >= 0) setAnim(kitten, ANIM_UP);
+		break;
+	}
+	case SLEEPING:
+		setAnim(kitten, ANIM_SLEEP);
+		break;
+	case PLAYING:
+		setAnim(kitten, ANIM_PLAY);
+		break;
+	}
+	updateAnim(kitten);
+
+	// Bubble setting.
+	showBubble(kitten, BUBBLE_NONE);
+	if (level(STAT_SICK) >= LEVEL_LOW) { showBubble(kitten, BUBBLE_PILL, kitten.sick() / 100); }
+	else if (level(STAT_NEEDY)  >= LEVEL_BAD) { showBubble(kitten, BUBBLE_PEE  , kitten.needy()  / 100); }
+	else if (level(STAT_HUNGRY) >= LEVEL_BAD) { showBubble(kitten, BUBBLE_FOOD , kitten.hungry() / 100); }
+	else if (level(STAT_TIRED)  >= LEVEL_BAD) { showBubble(kitten, BUBBLE_SLEEP, kitten.tired()  / 100); }
+	else if (level(STAT_BORED)  >= LEVEL_BAD) { showBubble(kitten, BUBBLE_TOY  , kitten.bored()  / 100); }
+	else if (level(STAT_NEEDY)  >= LEVEL_LOW) { showBubble(kitten, BUBBLE_PEE  , kitten.needy()  / 100); }
+	else if (level(STAT_HUNGRY) >= LEVEL_LOW) { showBubble(kitten, BUBBLE_FOOD , kitten.hungry() / 100); }
+	else if (level(STAT_TIRED)  >= LEVEL_LOW) { showBubble(kitten, BUBBLE_SLEEP, kitten.tired()  / 100); }
+	else if (level(STAT_BORED)  >= LEVEL_LOW) { showBubble(kitten, BUBBLE_TOY  , kitten.bored()  / 100); }
+
+	// Current activity.
+	kitten.t -= TICK_LENGTH_IN_SEC;
+	Vector2 npos = pos;
+	switch (kitten.s) {
 		case SITTING:
-		case EATING:
-		case PEEING:
-			setAnim(kitten, ANIM_IDLE);
+			if (kitten.rng.oneIn(8*TICKS_PER_SEC)) {
+				events.push_back(Event{ Event::SOUND, k, 0, "kittenmeow1.wav" });
+				wander(kitten);
+			} else if (kitten.rng.oneIn(12*TICKS_PER_SEC))
+				events.push_back(Event{ Event::SOUND, k, 0, "kittenmeow2.wav" });
+			else if (kitten.rng.oneIn(10*TICKS_PER_SEC))
+				events.push_back(Event{ Event::SOUND, k, 0, "kittenmeow3.wav" });
 			break;
-		case WALKING: {
-			Vector2 v = kitten.dst - entity.position2();
-			int axis;
-			v.cwiseAbs().maxCoeff(&axis);
-			if(axis == 0 && v(axis) <  0) setAnim(kitten, ANIM_LEFT);
-			if(axis == 0 && v(axis) >= 0) setAnim(kitten, ANIM_RIGHT);
-			if(axis == 1 && v(axis) <  0) setAnim(kitten, ANIM_DOWN);
-			if(axis == 1 && v(axis) >= 0) setAnim(kitten, ANIM_UP);
+	    case WALKING: {
+		    Vector2 v = goal - pos;
+			float dist = v.norm();
+			float walkDist = 100.0f * TICK_LENGTH_IN_SEC;
+			if(dist >= walkDist) v = (v / dist) * walkDist;
+
+			Vector2 vl = v;
+			Vector2 vr = v;
+			npos = pos + v;
+			AlignedBox2 box(npos - Vector2(16, 32), npos + Vector2(16, 0));
+			int tryCount = 0;
+			int nTries = (kitten.bypass == BYPASS_NONE)? (nDir - 1) * 2: nDir - 1;
+			BypassDir nextBypass = BYPASS_NONE;
+			while(_ms->_level->hitTest(box)) {
+				// Rotate v
+				if(kitten.bypass == BYPASS_LEFT ||
+				        (kitten.bypass == BYPASS_NONE && (tryCount & 1))) {
+					vl = rotL * vl;
+					v = vl;
+					nextBypass = BYPASS_LEFT;
+				}
+				if(kitten.bypass == BYPASS_RIGHT ||
+				        (kitten.bypass == BYPASS_NONE && !(tryCount & 1))) {
+					vr = rotR * vr;
+					v = vr;
+					nextBypass = BYPASS_RIGHT;
+				}
+
+				npos = pos + v;
+				box = AlignedBox2(npos - Vector2(16, 32), npos + Vector2(16, 0));
+
+				if(tryCount > nTries) {
+					// Stuck, should change target.
+					npos = pos;
+					break;
+				}
+				++tryCount;
+			}
+
+			kitten.bypass = nextBypass;
+
+			if(npos == pos) {
+				setAnim(kitten, ANIM_IDLE);
+				kitten.s = SITTING;
+			}
+
 			break;
-		}
+	    }
 		case SLEEPING:
-			setAnim(kitten, ANIM_SLEEP);
+			if (kitten.tired() > 0) {
+				kitten.tired() -= KIT_REST;
+				kitten.bored() += KIT_BPT;
+				kitten.bored() = std::min(kitten.bored(), KIT_LOW);
+				kitten.hungry() = std::min(kitten.hungry(), KIT_BAD);
+				kitten.needy() = std::min(kitten.needy(), KIT_BAD);
+			}
+			else
+				kitten.s = SITTING;
 			break;
 		case PLAYING:
-			setAnim(kitten, ANIM_PLAY);
+			if (kitten.bored() > 0) {
+				kitten.bored() -= KIT_PLAY;
+				kitten.tired() += KIT_FPT;
+			}
+			else
+				kitten.s = SITTING;
 			break;
-		}
-		updateAnim(kitten);
-
-		// Bubble setting.
-		setBubble(entity, BUBBLE_NONE);
-		if (kitten.sick > KIT_LOW) { setBubble(entity, BUBBLE_PILL, kitten.sick / 100); }
-		else if (kitten.needy  > KIT_BAD) { setBubble(entity, BUBBLE_PEE  , kitten.needy  / 100); }
-		else if (kitten.hungry > KIT_BAD) { setBubble(entity, BUBBLE_FOOD , kitten.hungry / 100); }
-		else if (kitten.tired  > KIT_BAD) { setBubble(entity, BUBBLE_SLEEP, kitten.tired  / 100); }
-		else if (kitten.bored  > KIT_BAD) { setBubble(entity, BUBBLE_TOY  , kitten.bored  / 100); }
-		else if (kitten.needy  > KIT_LOW) { setBubble(entity, BUBBLE_PEE  , kitten.needy  / 100); }
-		else if (kitten.hungry > KIT_LOW) { setBubble(entity, BUBBLE_FOOD , kitten.hungry / 100); }
-		else if (kitten.tired  > KIT_LOW) { setBubble(entity, BUBBLE_SLEEP, kitten.tired  / 100); }
-		else if (kitten.bored  > KIT_LOW) { setBubble(entity, BUBBLE_TOY  , kitten.bored  / 100); }
-
-		// Current activity.
-		kitten.t -= TICK_LENGTH_IN_SEC;
-		Vector2 npos = entity.position2();
-		switch (kitten.s) {
-			case SITTING:
-				if (rand()%(8*TICKS_PER_SEC) == 0) {
-					_ms->playSound("kittenmeow1.wav");
-					kitten.bored += KIT_BPT;
-					kitten.s = WALKING;
-					kitten.bypass = BYPASS_NONE;
-					kitten.dst = findRandomDest(entity.position2(), 400);
-				} else if (rand()%(12*TICKS_PER_SEC) == 0)
-					_ms->playSound("kittenmeow2.wav");
-				else if (rand()%(10*TICKS_PER_SEC) == 0)
-					_ms->playSound("kittenmeow3.wav");
-				break;
-		    case WALKING: {
-			    Vector2 v = kitten.dst - entity.position2();
-				float dist = v.norm();
-				float walkDist = 100.0f * TICK_LENGTH_IN_SEC;
-				if(dist >= walkDist) v = (v / dist) * walkDist;
-
-				Vector2 vl = v;
-				Vector2 vr = v;
-				npos = entity.position2() + v;
-				AlignedBox2 box(npos - Vector2(16, 32), npos + Vector2(16, 0));
-				int tryCount = 0;
-				int nTries = (kitten.bypass == BYPASS_NONE)? (nDir - 1) * 2: nDir - 1;
-				BypassDir nextBypass = BYPASS_NONE;
-				while(_ms->_level->hitTest(box)) {
-					// Rotate v
-					if(kitten.bypass == BYPASS_LEFT ||
-					        (kitten.bypass == BYPASS_NONE && (tryCount & 1))) {
-						vl = rotL * vl;
-						v = vl;
-						nextBypass = BYPASS_LEFT;
-					}
-					if(kitten.bypass == BYPASS_RIGHT ||
-					        (kitten.bypass == BYPASS_NONE && !(tryCount & 1))) {
-						vr = rotR * vr;
-						v = vr;
-						nextBypass = BYPASS_RIGHT;
-					}
-
-					npos = entity.position2() + v;
-					box = AlignedBox2(npos - Vector2(16, 32), npos + Vector2(16, 0));
-
-					if(tryCount > nTries) {
-						// Stuck, should change target.
-						npos = entity.position2();
-						break;
-					}
-					++tryCount;
-				}
+		case EATING:
+			if (kitten.hungry() > 0) {
+				kitten.hungry() -= KIT_FEED;
+				kitten.bored() -= KIT_BPT;
+				kitten.needy() += KIT_NPT;
+			}
+			else
+				kitten.s = SITTING;
+			break;
+		case PEEING:
+			if (kitten.needy() > 0)
+				kitten.needy() -= KIT_PISS;
+			else
+				kitten.s = SITTING;
+			break;
+	};
+	kitten.nextPos = npos;
+
+	// Shit happens to kitty.
+	if (kitten.sick() > KIT_MAX) { // 1
+		kitten.s = DECOMPOSING;
+		setAnim(kitten, ANIM_DEAD);
+		showBubble(kitten, BUBBLE_NONE);
+		events.push_back(Event{ Event::DEATH, k, 0, "Kit iz ded." });
+		return;
+	} else if (kitten.needy() > KIT_MAX) { // 2
+		kitten.s = PEEING;
+		kitten.t = 2;
+		kitten.nextToy = NO_TOY;
+		events.push_back(Event{ Event::HAPPINESS, k, -0.1f, "Oop kitty made a mess." });
+		return;
+	} else if (kitten.hungry() > KIT_MAX) { // 3
+		kitten.hungry() = KIT_LOW;
+		kitten.sick() = KIT_LOW;
+		events.push_back(Event{ Event::HAPPINESS, k, -0.08f, "Got sick from lack of food." });
+		return;
+	} else if (kitten.tired() > KIT_MAX) { // 4
+		kitten.s = SLEEPING;
+		kitten.t = 5;
+		kitten.nextToy = NO_TOY;
+		events.push_back(Event{ Event::HAPPINESS, k, -0.05f, "I sleep now." });
+		return;
+	} else if (kitten.bored() > KIT_MAX) { // 5
+		kitten.s = SLEEPING;
+		kitten.t = 2;
+		kitten.bored() = KIT_LOW;
+		kitten.nextToy = NO_TOY;
+		events.push_back(Event{ Event::HAPPINESS, k, -0.05f, "Sooooo boooooooZZZZzzz..." });
+		return;
+	}
 
-				kitten.bypass = nextBypass;
+	// What kitty steps on.
+	const AlignedBox2& box = _kittenBoxes[k];
+	unsigned options = 0x00;
+	unsigned toys[TOY_TYPE_COUNT];
+	for (unsigned tt = 0; tt < TOY_TYPE_COUNT; ++tt) { // Toys ?
+		// TOY_FEED: 0x01, TOY_PLAY: 0x02, TOY_PISS: 0x04, TOY_HEAL: 0x08, TOY_SLEEP: 0x10
+		const SpatialGrid::Item* toy = _toyGrids[tt].find(box);
+		toys[tt] = toy? toy->id: NO_TOY;
+		if (toy) { options |= 1 << tt; }
+	}
+	if (_kittenGrid.intersects(box, k)) { options |= 0x20; } // Other kit ?
 
-				if(npos == entity.position2()) {
-					setAnim(kitten, ANIM_IDLE);
-					kitten.s = SITTING;
-				}
+	// Kitty is pondering things.
+	if (kitten.s > WALKING && kitten.t > 0)
+		return;
 
-				break;
-		    }
-			case SLEEPING:
-				if (kitten.tired > 0) {
-					kitten.tired -= KIT_REST;
-					kitten.bored += KIT_BPT;
-					kitten.bored = std::min(kitten.bored, KIT_LOW);
-					kitten.hungry = std::min(kitten.hungry, KIT_BAD);
-					kitten.needy = std::min(kitten.needy, KIT_BAD);
-				}
-				else
-					kitten.s = SITTING;
-				break;
-			case PLAYING:
-				if (kitten.bored > 0) {
-					kitten.bored -= KIT_PLAY;
-					kitten.tired += KIT_FPT;
-				}
-				else
-					kitten.s = SITTING;
-				break;
-			case EATING:
-				if (kitten.hungry > 0) {
-					kitten.hungry -= KIT_FEED;
-					kitten.bored -= KIT_BPT;
-					kitten.needy += KIT_NPT;
-				}
-				else
-					kitten.s = SITTING;
-				break;
-			case PEEING:
-				if (kitten.needy > 0)
-					kitten.needy -= KIT_PISS;
-				else
-					kitten.s = SITTING;
-				break;
-		};
-		entity.moveTo(npos);
-
-		// Shit happens to kitty.
-		if (kitten.sick > KIT_MAX) { // 1
-			kitten.s = DECOMPOSING;
-			_ms->setSpawnDeath(_ms->_spawnCount, _ms->_deathCount + 1);
-			_ms->playSound("kittendeath.wav");
-			setAnim(kitten, ANIM_DEAD);
-			setBubble(entity, BUBBLE_NONE);
-			kitten.setEnabled(false);
-			dbgLogger.warning("Kit iz ded.");
-			continue;
-		} else if (kitten.needy > KIT_MAX) { // 2
-			kitten.s = PEEING;
-			kitten.t = 2;
-			_ms->setHappiness(_ms->_happiness - 0.1);
-			dbgLogger.warning("Oop kitty made a mess.");
+	if (kitten.sick() > KIT_LOW) { // 6
+		kitten.bored() = KIT_BAD - TICKS_PER_SEC * KIT_BPT;
+		if (options & 0x08) {
+			kitten.sick() = 0;
+			kitten.hungry() = KIT_LOW;
+			kitten.tired() = KIT_BAD;
+		} else
+			seek(kitten,TOY_HEAL, true);
+		return;
+	}
+
+	for (KittenComponent::stat threshold: {KIT_BAD, KIT_LOW})
+	{
+		if (kitten.needy() > threshold) { // 7/B
+			if (options & 0x04) {
+				kitten.s = PEEING;
+				kitten.t = 1;
+				kitten.nextToy = toys[TOY_PISS];
+			} else
+				seek(kitten,TOY_PISS, threshold == KIT_BAD);
 			continue;
-		} else if (kitten.hungry > KIT_MAX) { // 3
-			kitten.hungry = KIT_LOW;
-			kitten.sick = KIT_LOW;
-			_ms->setHappiness(_ms->_happiness - 0.08);
-			dbgLogger.warning("Got sick from lack of food.");
+		} else if (kitten.hungry() > threshold) { // 8/C
+			if (options & 0x01) {
+				kitten.s = EATING;
+				kitten.t = 2;
+				kitten.nextToy = toys[TOY_FEED];
+			} else
+				seek(kitten,TOY_FEED, threshold == KIT_BAD);
 			continue;
-		} else if (kitten.tired > KIT_MAX) { // 4
-			kitten.s = SLEEPING;
-			kitten.t = 5;
-			_ms->setHappiness(_ms->_happiness - 0.05);
-			dbgLogger.warning("I sleep now.");
+		} else if (kitten.tired() > threshold) { // 9/D
+			if (options & 0x10) {
+				kitten.s = SLEEPING;
+				kitten.t = 5;
+				kitten.nextToy = toys[TOY_SLEEP];
+			} else
+				seek(kitten,TOY_SLEEP, threshold == KIT_BAD);
 			continue;
-		} else if (kitten.bored > KIT_MAX) { // 5
-			kitten.s = SLEEPING;
-			kitten.t = 2;
-			kitten.bored = KIT_LOW;
-			_ms->setHappiness(_ms->_happiness - 0.05);
-			dbgLogger.warning("Sooooo boooooooZZZZzzz...");
+		} else if (kitten.bored() > threshold) { // A/E
+			if (options & 0x22) {
+				kitten.s = PLAYING;
+				kitten.t = 1;
+				kitten.nextToy = toys[TOY_PLAY]; // NO_TOY with another kitten.
+			} else
+				seek(kitten,TOY_PLAY, threshold == KIT_BAD);
 			continue;
 		}
+	}
+}
+
+static unsigned statLevel(float x) {
+	return (x > KIT_LOW) + (x > KIT_BAD) + (x > KIT_MAX);
+}
+
+// Stats after nTicks (> 0) ticks without state change, as updateStats() and
+// updateKitten() would compute them. Stats only grow or shrink linearly and
+// the clamps commute with the growth, so this does not need a loop.
+void KittenComponentManager::restStats(const KittenComponent& kitten, unsigned nTicks,
+                                       float* stats) const {
+	float n = nTicks;
+
+	stats[STAT_SICK]   = kitten.sick() * std::pow(1.003f, n);
+	stats[STAT_TIRED]  = kitten.tired()  + n * KIT_FPT;
+	stats[STAT_BORED]  = kitten.bored()  + n * KIT_BPT;
+	stats[STAT_HUNGRY] = kitten.hungry() + n * KIT_HPT;
+	stats[STAT_NEEDY]  = kitten.needy()  + n * KIT_NPT;
+
+	switch(kitten.s) {
+	case SLEEPING:
+		stats[STAT_TIRED] -= n * KIT_REST;
+		stats[STAT_BORED]  = std::min(stats[STAT_BORED] + n * KIT_BPT, KIT_LOW);
+		stats[STAT_HUNGRY] = std::min(stats[STAT_HUNGRY], KIT_BAD);
+		stats[STAT_NEEDY]  = std::min(stats[STAT_NEEDY],  KIT_BAD);
+		break;
+	case PLAYING:
+		stats[STAT_BORED] -= n * KIT_PLAY;
+		stats[STAT_TIRED] += n * KIT_FPT;
+		break;
+	case EATING:
+		stats[STAT_HUNGRY] -= n * KIT_FEED;
+		stats[STAT_BORED]  -= n * KIT_BPT;
+		stats[STAT_NEEDY]  += n * KIT_NPT;
+		break;
+	case PEEING:
+		stats[STAT_NEEDY] -= n * KIT_PISS;
+		break;
+	}
+}
 
-		// What kitty steps on.
-		std::deque<EntityRef> hits;
-		AlignedBox2 box = _ms->_collisions.get(entity)->shapes()[0].transformed(entity.worldTransform().matrix()).asAlignedBox();
-		_ms->_collisions.hitTest(hits, box, HIT_TOY, entity);
-		unsigned options = 0x00;
-		for (EntityRef e: hits) { // Toys ?
-			ToyComponent* t = _ms->_toys.get(e);
-			if (!t || t->state != t->PLACED) { continue; }
-			if      (t->type == TOY_FEED)  { options |= 0x01; }
-			else if (t->type == TOY_PLAY)  { options |= 0x02; }
-			else if (t->type == TOY_PISS)  { options |= 0x04; }
-			else if (t->type == TOY_HEAL)  { options |= 0x08; }
-			else if (t->type == TOY_SLEEP) { options |= 0x10; }
+// A kitten sits out the next ticks if nothing but its stats can change
+// until then: it is busy (or sitting with no need), shows the right
+// animation and no stat crosses a level, which would change its bubble or
+// trigger something. Its stats are caught up by wakeKitten(). Called by the
+// parallel update, after updateKitten().
+void KittenComponentManager::scheduleKitten(unsigned ai) {
+	unsigned k = _active[ai];
+	KittenComponent& kitten = _components[k];
+	kitten.lodSkip = 0;
+
+	int        activity;
+	KittenAnim anim;
+	switch(kitten.s) {
+	case SITTING:  activity = -1;          anim = ANIM_IDLE;  break;
+	case SLEEPING: activity = STAT_TIRED;  anim = ANIM_SLEEP; break;
+	case PLAYING:  activity = STAT_BORED;  anim = ANIM_PLAY;  break;
+	case EATING:   activity = STAT_HUNGRY; anim = ANIM_IDLE;  break;
+	case PEEING:   activity = STAT_NEEDY;  anim = ANIM_IDLE;  break;
+	default:       return;
+	}
+	if(kitten.anim != anim)
+		return;
+
+	// Levels seen by this tick, which chose the bubble. Past the max, bad
+	// things happen every tick.
+	auto level = _statLevels.row(k);
+	for(unsigned si = 0; si < STAT_COUNT; ++si) {
+		if(level(si) == LEVEL_MAX || statLevel(kitten.statAt(si)) != level(si))
+			return;
+		// Sitting kittens with a need look for a toy every tick.
+		if(activity < 0 && level(si) != LEVEL_OK)
+			return;
+	}
+
+	float stats[STAT_COUNT];
+	for(unsigned nTicks: { KIT_LOD_LONG, KIT_LOD_SHORT }) {
+		unsigned nSkip = nTicks - 1;
+		restStats(kitten, nSkip, stats);
+
+		bool canSkip = true;
+		for(unsigned si = 0; si < STAT_COUNT; ++si)
+			canSkip = canSkip && statLevel(stats[si]) == level(si);
+		// Busy kittens must stay busy.
+		if(activity >= 0) {
+			canSkip = canSkip && kitten.t - nSkip * TICK_LENGTH_IN_SEC > 0
+			                  && stats[activity] > 0;
 		}
-		hits.clear(); // Other kit ?
-		_ms->_collisions.hitTest(hits, box, HIT_KITTEN, entity);
-		if (!hits.empty()) { options |= 0x20; }
 
-		// Kitty is pondering things.
-		if (kitten.s > WALKING && kitten.t > 0)
-			continue;
+		if(canSkip) {
+			kitten.lodSkip = nSkip;
+			return;
+		}
+	}
+}
 
-		if (kitten.sick > KIT_LOW) { // 6
-			kitten.bored = KIT_BAD - TICKS_PER_SEC * KIT_BPT;
-			if (options & 0x08) {
-				kitten.sick = 0;
-				kitten.hungry = KIT_LOW;
-				kitten.tired = KIT_BAD;
-			} else
-				seek(kitten,TOY_HEAL, true);
-			continue;
+// Catch up with the ticks sat out. Random events that would have happened
+// during these ticks happen now.
+void KittenComponentManager::wakeKitten(KittenComponent& kitten) {
+	unsigned nSkipped = kitten.lodSkipped;
+	kitten.lodSkipped = 0;
+
+	float stats[STAT_COUNT];
+	restStats(kitten, nSkipped, stats);
+	for(unsigned si = 0; si < STAT_COUNT; ++si)
+		kitten.statAt(si) = stats[si];
+
+	kitten.t        -= nSkipped * TICK_LENGTH_IN_SEC;
+	kitten.animTime += nSkipped * TICK_LENGTH_IN_SEC;
+
+	for(unsigned ti = 0; ti < nSkipped; ++ti) {
+		if (!kitten.sick() && kitten.rng.oneIn(180*TICKS_PER_SEC))
+			kitten.sick() = KIT_LOW;
+		if (kitten.s == SITTING && kitten.rng.oneIn(8*TICKS_PER_SEC)) {
+			wander(kitten);
+			break;
 		}
+	}
+}
+
+void KittenComponentManager::applyKitten(KittenComponent& kitten) {
+	EntityRef entity = kitten.entity();
+	entity.moveTo(kitten.nextPos);
 
-		for (KittenComponent::stat threshold: {KIT_BAD, KIT_LOW})
-		{
-			if (kitten.needy > threshold) { // 7/B
-				if (options & 0x04) {
-					kitten.s = PEEING;
-					kitten.t = 1;
-				} else
-					seek(kitten,TOY_PISS, threshold == KIT_BAD);
-				continue;
-			} else if (kitten.hungry > threshold) { // 8/C
-				if (options & 0x01) {
-					kitten.s = EATING;
-					kitten.t = 2;
-				} else
-					seek(kitten,TOY_FEED, threshold == KIT_BAD);
-				continue;
-			} else if (kitten.tired > threshold) { // 9/D
-				if (options & 0x10) {
-					kitten.s = SLEEPING;
-					kitten.t = 5;
-				} else
-					seek(kitten,TOY_SLEEP, threshold == KIT_BAD);
-				continue;
-			} else if (kitten.bored > threshold) { // A/E
-				if (options & 0x22) {
-					kitten.s = PLAYING;
-					kitten.t = 1;
-				} else
-					seek(kitten,TOY_PLAY, threshold == KIT_BAD);
-				continue;
+	SpriteComponent* sprite = _ms->_sprites.get(entity);
+	if(!sprite)
+		dbgLogger.error("Kitten without sprite ?");
+	else if(sprite->tileIndex() != kitten.tileIndex)
+		sprite->setTileIndex(kitten.tileIndex);
+
+	setBubble(entity, kitten.bubble, kitten.bubbleIntensity);
+
+	bool onToy = kitten.s == SLEEPING || kitten.s == PLAYING ||
+	             kitten.s == EATING   || kitten.s == PEEING;
+	if(!onToy || kitten.nextToy == NO_TOY)
+		releaseToy(kitten);
+	else if(kitten.nextToy != KEEP_TOY) {
+		ToyComponent& toy = _ms->_toys.toyAt(kitten.nextToy);
+		if(!(kitten.toy == toy.entity()) || kitten.toyPlacement != toy.placement) {
+			releaseToy(kitten);
+			// Filled up or picked up since the grids were built.
+			if(toy.state != ToyComponent::PLACED) {
+				kitten.s       = SITTING;
+				kitten.lodSkip = 0;
+				return;
 			}
+			kitten.toy          = toy.entity();
+			kitten.toyPlacement = toy.placement;
+			_ms->_toys.addUser(toy);
 		}
 	}
 }
 
+void KittenComponentManager::applyEvent(const Event& event) {
+	switch(event.type) {
+	case Event::SOUND:
+		_ms->playSound(event.text);
+		break;
+	case Event::HAPPINESS:
+		_ms->setHappiness(_ms->_happiness + event.value);
+		dbgLogger.warning(event.text);
+		break;
+	case Event::DEATH:
+		_ms->setSpawnDeath(_ms->_spawnCount, _ms->_deathCount + 1);
+		_ms->playSound("kittendeath.wav");
+		_components[event.kitten].setEnabled(false);
+		_ms->addCorpse(_components[event.kitten].entity());
+		dbgLogger.warning(event.text);
+		break;
+	}
+}
+
+bool KittenComponentManager::hasToy(const KittenComponent& kitten) const {
+	if(!kitten.toy.isValid())
+		return false;
+	ToyComponent* toy = _ms->_toys.get(kitten.toy);
+	return toy && toy->placement == kitten.toyPlacement;
+}
+
+void KittenComponentManager::releaseToy(KittenComponent& kitten) {
+	if(!kitten.toy.isValid())
+		return;
+
+	// Users of a toy that was picked up since are already dropped.
+	if(hasToy(kitten))
+		_ms->_toys.removeUser(*_ms->_toys.get(kitten.toy));
+	kitten.toy.release();
+}
+
+void KittenComponentManager::checkToyUsers() const {
+#ifndef NDEBUG
+	std::unordered_map<const ToyComponent*, unsigned> users;
+	for(unsigned k = 0; k < nComponents(); ++k) {
+		if(hasToy(_components[k]))
+			++users[_ms->_toys.get(_components[k].toy)];
+	}
+	for(unsigned ti = 0; ti < _ms->_toys.nComponents(); ++ti) {
+		const ToyComponent& toy = _ms->_toys.toyAt(ti);
+		auto it = users.find(&toy);
+		lairAssert(toy.users == ((it == users.end())? 0: it->second));
+		lairAssert(toy.users <= ToyComponentManager::capacity(toy.type));
+	}
+#endif
+}
+
+void KittenComponentManager::resetKitten(KittenComponent& kitten, const KittenComponent& model) {
+	kitten.sick()   = model.sick();
+	kitten.tired()  = model.tired();
+	kitten.bored()  = model.bored();
+	kitten.hungry() = model.hungry();
+	kitten.needy()  = model.needy();
+	kitten.s      = model.s;
+	kitten.t      = model.t;
+	kitten.dst    = model.dst;
+
+	kitten.seekType        = TOY_TYPE_COUNT;
+	kitten.anim            = model.anim;
+	kitten.animTime        = 0;
+	kitten.tileIndex       = model.tileIndex;
+	kitten.bubble          = BUBBLE_NONE;
+	kitten.bubbleIntensity = 0;
+	kitten.nextToy         = KEEP_TOY;
+	kitten.lodSkip         = 0;
+	kitten.lodSkipped      = 0;
+	kitten.toy             = EntityRef();
+	kitten.toyPlacement    = 0;
+	kitten.occupancyId     = 0;
+	kitten.setEnabled(true);
+
+	// Do not show the corpse until the first update.
+	EntityRef entity = kitten.entity();
+	SpriteComponent* sprite = _ms->_sprites.get(entity);
+	if(sprite)
+		sprite->setTileIndex(kitten.tileIndex);
+	setBubble(entity, BUBBLE_NONE);
+}
+
+const SpatialGrid& KittenComponentManager::kittenGrid() const {
+	return _kittenGrid;
+}
+
+const SpatialGrid& KittenComponentManager::toyGrid(ToyType type) const {
+	return _toyGrids[type];
+}
+
 //---------------------------------------------------------------------------//
 
 
@@ -508,6 +955,8 @@ ToyComponent::ToyComponent(Manager* manager, _Entity* entity)
     , size(1, 1)
     , cost(10)
     , state(NONE)
+    , users(0)
+    , placement(0)
 {
 }
 
@@ -525,58 +974,128 @@ const PropertyList& ToyComponent::properties() {
 
 ToyComponentManager::ToyComponentManager(MainState* ms)
     : DenseComponentManager<ToyComponent>("toy", 128),
-    _ms(ms)
+    _ms(ms),
+    _flowLevel(nullptr)
 {
+	for(bool& dirty: _flowDirty)
+		dirty = true;
 }
 
-void ToyComponentManager::update() {
-	compactArray();
+AlignedBox2 ToyComponentManager::toyBox(ToyComponent& toy) const {
+	// Same as GameView::canPlaceToy.
+	Vector2 pos = toy.entity().position2();
+	Vector2 size = toy.size.cast<float>() * PLACEMENT_TILE_SIZE;
+	return AlignedBox2(pos + Vector2(.1, .1), pos + size - Vector2(.1, .1));
+}
 
-	for(unsigned ti = 0; ti < nComponents(); ++ti) {
-		ToyComponent& toy = _components[ti];
-		EntityRef entity = toy.entity();
+void ToyComponentManager::resetFlowFields() {
+	_flowLevel = nullptr;
+	_flowSources.clear();
+}
+
+void ToyComponentManager::updateFlowFields() {
+	if(_flowLevel != _ms->_level.get()) {
+		_flowLevel = _ms->_level.get();
+		for(unsigned tt = 0; tt < TOY_TYPE_COUNT; ++tt) {
+			_flowFields[tt].reset(_flowLevel);
+			_flowDirty[tt] = true;
+		}
+	}
+
+	for(const FlowSource& source: _flowSources) {
+		// Dirty fields are rebuilt from scratch just below.
+		if(!_flowDirty[source.type])
+			_flowFields[source.type].addSource(source.box, source.target);
+	}
+	_flowSources.clear();
 
-		if(!entity.isEnabledRec() || !toy.isEnabled())
+	for(unsigned tt = 0; tt < TOY_TYPE_COUNT; ++tt) {
+		if(!_flowDirty[tt])
 			continue;
 
-		// Count current user and set busy state.
-		if (toy.state == toy.PLACED || toy.state == toy.BUSY) {
-			toy.state = toy.PLACED;
-			std::deque<EntityRef> hits;
-			AlignedBox2 box = _ms->_collisions.get(entity)->shapes()[0].transformed(entity.worldTransform().matrix()).asAlignedBox();
-			_ms->_collisions.hitTest(hits, box, HIT_KITTEN, entity);
-			unsigned users = 0;
-			for (EntityRef e: hits) {
-				KittenComponent* k = _ms->_kittens.get(e);
-				switch (toy.type) {
-					case TOY_FEED:
-						if (k->s == EATING)
-							users++;
-						if (users > 2)
-							toy.state = toy.BUSY;
-						break;
-					case TOY_PLAY:
-						if (k->s == PLAYING)
-							users++;
-						if (users > 1)
-							toy.state = toy.BUSY;
-						break;
-					case TOY_PISS:
-						if (k->s == PEEING)
-							users++;
-						if (users > 0)
-							toy.state = toy.BUSY;
-						break;
-					case TOY_SLEEP:
-						if (k->s == SLEEPING)
-							users++;
-						if (users > 1)
-							toy.state = toy.BUSY;
-						break;
-					default:
-						break;
-				}
-			}
+		FlowField& field = _flowFields[tt];
+		field.clear();
+		for(ToyComponent& toy: *this) {
+			if(toy.type == tt && toy.entity().isEnabledRec() &&
+			        toy.state == ToyComponent::PLACED)
+				field.seed(toyBox(toy), toy.entity().position2());
 		}
+		field.propagate();
+		_flowDirty[tt] = false;
+	}
+}
+
+void ToyComponentManager::addToFlowField(ToyComponent& toy) {
+	_flowSources.push_back(FlowSource{ toy.type, toyBox(toy), toy.entity().position2() });
+}
+
+void ToyComponentManager::invalidateFlowField(ToyType type) {
+	_flowDirty[type] = true;
+}
+
+const FlowField& ToyComponentManager::flowField(ToyType type) const {
+	return _flowFields[type];
+}
+
+void ToyComponentManager::update() {
+	checkCompact();
+}
+
+void ToyComponentManager::compact() {
+	compactArray();
+}
+
+void ToyComponentManager::checkCompact() const {
+#ifndef NDEBUG
+	for(unsigned ti = 0; ti < nComponents(); ++ti)
+		lairAssert(_components[ti].entity().isValid());
+#endif
+}
+
+unsigned ToyComponentManager::capacity(ToyType type) {
+	switch(type) {
+	case TOY_FEED:  return 3;
+	case TOY_PLAY:  return 2;
+	case TOY_PISS:  return 1;
+	case TOY_SLEEP: return 2;
+	default:        return unsigned(-1);
 	}
 }
+
+ToyComponent& ToyComponentManager::toyAt(unsigned index) {
+	return _components[index];
+}
+
+void ToyComponentManager::addUser(ToyComponent& toy) {
+	++toy.users;
+	updateBusy(toy);
+}
+
+void ToyComponentManager::removeUser(ToyComponent& toy) {
+	lairAssert(toy.users);
+	--toy.users;
+	updateBusy(toy);
+}
+
+void ToyComponentManager::dropUsers(ToyComponent& toy) {
+	toy.users = 0;
+	++toy.placement;
+	updateBusy(toy);
+}
+
+void ToyComponentManager::updateBusy(ToyComponent& toy) {
+	if(toy.state != ToyComponent::PLACED && toy.state != ToyComponent::BUSY)
+		return;
+
+	ToyComponent::State state = (toy.users >= capacity(toy.type))?
+	                                ToyComponent::BUSY: ToyComponent::PLACED;
+	if(state == toy.state)
+		return;
+	toy.state = state;
+
+	// Flow fields only lead to free toys.
+	if(state == ToyComponent::BUSY)
+		invalidateFlowField(toy.type);
+	else
+		addToFlowField(toy);
+}
@@ -34,6 +34,11 @@
 #include <lair/ec/dense_component_manager.h>
 #include <lair/ec/collision_component.h>
 
+#include "command.h"
+#include "spatial_grid.h"
+#include "flow_field.h"
+#include "rng.h"
+
 
 using namespace lair;
 
@@ -62,6 +67,23 @@ typedef enum {
 	DECOMPOSING
 } status;
 
+enum KittenStat {
+	STAT_SICK,
+	STAT_TIRED,
+	STAT_BORED,
+	STAT_HUNGRY,
+	STAT_NEEDY,
+
+	STAT_COUNT
+};
+
+enum StatLevel {
+	LEVEL_OK,
+	LEVEL_LOW,
+	LEVEL_BAD,
+	LEVEL_MAX,
+};
+
 enum BubbleType {
 	BUBBLE_PEE,
 	BUBBLE_TOY,
@@ -95,6 +117,8 @@ enum ToyType {
 	TOY_PISS,
 	TOY_HEAL,
 	TOY_SLEEP,
+
+	TOY_TYPE_COUNT
 };
 const lair::EnumInfo* toyTypeInfo();
 
@@ -114,11 +138,16 @@ public:
 	static const PropertyList& properties();
 
 public:
-	bool        prevInside;
-	bool        inside;
+	// 0 until seen by MainState::updateTriggers().
+	unsigned    occupancyId;
 	std::string onEnter;
 	std::string onExit;
 	std::string onUse;
+
+	// Compiled on first use, see MainState::compiled().
+	CommandProgramSP onEnterProgram;
+	CommandProgramSP onExitProgram;
+	CommandProgramSP onUseProgram;
 };
 
 class TriggerComponentManager : public DenseComponentManager<TriggerComponent> {
@@ -143,39 +172,174 @@ public:
 
 	static const PropertyList& properties();
 
-public:
+	// The stats live in the columns of the manager, at statRow.
 	typedef float stat;
-	stat sick;
-	stat tired;
-	stat bored;
-	stat hungry;
-	stat needy;
+	stat& sick()   { return statAt(STAT_SICK); }
+	stat& tired()  { return statAt(STAT_TIRED); }
+	stat& bored()  { return statAt(STAT_BORED); }
+	stat& hungry() { return statAt(STAT_HUNGRY); }
+	stat& needy()  { return statAt(STAT_NEEDY); }
+	stat sick()   const { return statAt(STAT_SICK); }
+	stat tired()  const { return statAt(STAT_TIRED); }
+	stat bored()  const { return statAt(STAT_BORED); }
+	stat hungry() const { return statAt(STAT_HUNGRY); }
+	stat needy()  const { return statAt(STAT_NEEDY); }
+
+	inline stat& statAt(unsigned si);
+	inline stat  statAt(unsigned si) const;
+
+	// For properties().
+	template<unsigned Si>
+	inline const stat& statProperty() const;
+	template<unsigned Si>
+	inline void setStatProperty(const stat& value);
+
+public:
+	Manager* statManager;
+	unsigned statRow;
 
 	unsigned s; // Not "status s;" because fuck it, that's why.
 	double t;
 	Vector2 dst;
+	ToyType seekType; // TOY_TYPE_COUNT if dst is not a toy.
 	BypassDir bypass;
 
 	KittenAnim anim;
 	float      animTime;
+
+	// Position at the beginning of the tick, taken by updateGrids(). The
+	// parallel update reads it instead of the entity, which is not safe to
+	// touch off the main thread.
+	Vector2    pos;
+
+	// Computed by the parallel update, applied to the entity afterward.
+	unsigned   tileIndex;
+	BubbleType bubble;
+	float      bubbleIntensity;
+	Vector2    nextPos;
+	// KEEP_TOY, NO_TOY or the id of the toy to use in the toy grids.
+	unsigned   nextToy;
+
+	// Ticks the kitten sits out, and ticks sat out so far, see
+	// KittenComponentManager::scheduleKitten().
+	unsigned   lodSkip;
+	unsigned   lodSkipped;
+
+	// Toy the kitten is eating on, playing with, etc. and its placement
+	// when the kitten registered. Only touched by the serial update.
+	EntityRef  toy;
+	unsigned   toyPlacement;
+
+	// Seeded by MainState::spawnKitten.
+	Rng rng;
+
+	// 0 until seen by MainState::updateTriggers().
+	unsigned occupancyId;
 };
 
 class KittenComponentManager : public DenseComponentManager<KittenComponent> {
+public:
+	// Side effects of a kitten update on the rest of the game.
+	struct Event {
+		enum Type {
+			SOUND,
+			HAPPINESS,
+			DEATH,
+		};
+
+		Type        type;
+		unsigned    kitten;
+		float       value;
+		const char* text;
+	};
+	typedef std::vector<Event> EventList;
+
+	enum {
+		KEEP_TOY = unsigned(-1),
+		NO_TOY   = unsigned(-2),
+	};
+
 public:
 	KittenComponentManager(MainState* ms);
 	virtual ~KittenComponentManager() = default;
 
 
+	void updateGrids();
+	void updateStats();
+
 	void setBubble(EntityRef kitten, BubbleType bubbleType, float intensity = 0);
+	void showBubble(KittenComponent& kitten, BubbleType bubbleType, float intensity = 0);
 	void setAnim(KittenComponent& kitten, KittenAnim anim);
 	void updateAnim(KittenComponent& kitten);
 	void seek(KittenComponent& k, ToyType tt, bool now);
-	Vector2 findRandomDest(const Vector2& p, float radius);
+	Vector2 walkGoal(KittenComponent& kitten);
+	Vector2 findRandomDest(Rng& rng, const Vector2& p, float radius);
+	void wander(KittenComponent& kitten);
 	float urgency(float x);
+	// update() does the three steps. Only runUpdate() may overlap with
+	// something else: it does not write to the game and does not build
+	// EntityRefs, positions come from KittenComponent::pos.
 	void update();
+	// Kittens are never destroyed during play: dead ones go back to the
+	// pool. MainState::loadLevel() destroys them all and calls this right
+	// away, debug builds check that no other destruction left a hole.
+	void compact();
+	void checkCompact() const;
+	void beginUpdate();
+	void runUpdate();
+	void endUpdate();
+	void updateKitten(unsigned ai, EventList& events);
+	void restStats(const KittenComponent& kitten, unsigned nTicks, float* stats) const;
+	void scheduleKitten(unsigned ai);
+	void wakeKitten(KittenComponent& kitten);
+	void applyKitten(KittenComponent& kitten);
+	void applyEvent(const Event& event);
+	// True if kitten is counted in the users of its toy, which is false
+	// once the toy is picked up.
+	bool hasToy(const KittenComponent& kitten) const;
+	void releaseToy(KittenComponent& kitten);
+	// Debug builds check that the users of each toy are the kittens that
+	// have it, and never more than its capacity.
+	void checkToyUsers() const;
+	// Back to the state of model, for kittens taken from the pool.
+	void resetKitten(KittenComponent& kitten, const KittenComponent& model);
+
+	const SpatialGrid& kittenGrid() const;
+	const SpatialGrid& toyGrid(ToyType type) const;
+
+	// Stats of all the kittens, one column per KittenStat. Row k belongs to
+	// the component k, as compact() keeps them in step; only the first
+	// nComponents() rows are used.
+	typedef Eigen::Array<float,   Eigen::Dynamic, STAT_COUNT> StatArray;
+	typedef Eigen::Array<uint8_t, Eigen::Dynamic, STAT_COUNT> StatLevelArray;
+	StatArray&       statStore()       { return _stats; }
+	const StatArray& statStore() const { return _stats; }
+	// Called by the KittenComponent constructor.
+	unsigned allocStatRow();
 
 public:
 	MainState* _ms;
+
+protected:
+	// Rebuilt at the beginning of each tick. Ids are component indices.
+	SpatialGrid _kittenGrid;
+	SpatialGrid _toyGrids[TOY_TYPE_COUNT];
+	std::vector<AlignedBox2> _kittenBoxes;
+
+	// Grown geometrically, _nStatRows rows are allocated.
+	StatArray _stats;
+	unsigned  _nStatRows;
+
+	// Kittens updated this tick, as component indices and as a mask over
+	// the rows of _stats. Levels are by component.
+	typedef Eigen::Array<bool, Eigen::Dynamic, 1> ActiveMask;
+	std::vector<unsigned> _active;
+	ActiveMask            _activeMask;
+	StatLevelArray        _statLevels;
+
+	// One list per chunk of the parallel update.
+	unsigned               _nChunks;
+	std::vector<EventList> _events;
 };
 
 class ToyComponent : public Component {
@@ -208,6 +372,12 @@ public:
 	State         state;
 	State         startState;
 	lair::Vector2 startPos;
+
+	// Kittens using the toy, the toy is BUSY when this reaches its
+	// capacity. Picking the toy up bumps placement and drops them all; they
+	// get off it at the next KittenComponentManager::updateStats().
+	unsigned      users;
+	unsigned      placement;
 };
 
 class ToyComponentManager : public DenseComponentManager<ToyComponent> {
@@ -216,12 +386,68 @@ public:
 	virtual ~ToyComponentManager() = default;
 
 	void update();
+	// Unused toys go back to their pool instead of being destroyed, see
+	// KittenComponentManager::compact().
+	void compact();
+	void checkCompact() const;
+
+	AlignedBox2 toyBox(ToyComponent& toy) const;
+
+	// Kittens only ever use PLACED toys. Occupancy is updated when kittens
+	// start or stop using a toy, not polled.
+	static unsigned capacity(ToyType type);
+	ToyComponent& toyAt(unsigned index);
+	void addUser(ToyComponent& toy);
+	void removeUser(ToyComponent& toy);
+	void dropUsers(ToyComponent& toy);
+	void updateBusy(ToyComponent& toy);
+
+	// Flow fields are only modified by updateFlowFields(), at the beginning
+	// of a tick and only lead to PLACED toys. Placing a toy or freeing a
+	// BUSY one is cheap; moving or removing one, or filling it up, triggers
+	// a full recompute of the field of its type.
+	void resetFlowFields();
+	void updateFlowFields();
+	void addToFlowField(ToyComponent& toy);
+	void invalidateFlowField(ToyType type);
+	const FlowField& flowField(ToyType type) const;
 
 public:
 	MainState* _ms;
+
+protected:
+	struct FlowSource {
+		ToyType     type;
+		AlignedBox2 box;
+		Vector2     target;
+	};
+
+	const Level*            _flowLevel;
+	FlowField               _flowFields[TOY_TYPE_COUNT];
+	bool                    _flowDirty[TOY_TYPE_COUNT];
+	std::vector<FlowSource> _flowSources;
 };
 
 LAIR_REGISTER_METATYPE(ToyType, "ToyType");
 
 
+inline KittenComponent::stat& KittenComponent::statAt(unsigned si) {
+	return statManager->statStore()(statRow, si);
+}
+
+inline KittenComponent::stat KittenComponent::statAt(unsigned si) const {
+	return statManager->statStore()(statRow, si);
+}
+
+template<unsigned Si>
+inline const KittenComponent::stat& KittenComponent::statProperty() const {
+	return statManager->statStore()(statRow, Si);
+}
+
+template<unsigned Si>
+inline void KittenComponent::setStatProperty(const stat& value) {
+	statAt(Si) = value;
+}
+
+
 #endif
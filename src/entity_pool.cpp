@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+
+#include "entity_pool.h"
+
+
+EntityPool::EntityPool()
+    : _entities(nullptr),
+      _target(0) {
+}
+
+
+void EntityPool::reset(EntityManager* entities, EntityRef model, EntityRef parent,
+                       const char* name, unsigned target) {
+	_spares.clear();
+	_entities = entities;
+	_model    = model;
+	_parent   = parent;
+	_name     = name? name: "";
+	_target   = target;
+	reserve(target);
+}
+
+
+void EntityPool::refill() {
+	if(_spares.size() < _target && _model.isValid())
+		_spares.push_back(clone());
+}
+
+
+void EntityPool::reserve(unsigned count) {
+	_spares.reserve(std::max<size_t>(count, _spares.capacity()));
+	while(_spares.size() < count && _model.isValid())
+		_spares.push_back(clone());
+}
+
+
+EntityRef EntityPool::acquire() {
+	EntityRef entity;
+	if(_spares.empty())
+		entity = clone();
+	else {
+		entity = _spares.back();
+		_spares.pop_back();
+	}
+	entity.setEnabled(true);
+	return entity;
+}
+
+
+void EntityPool::release(EntityRef entity) {
+	lairAssert(entity.isValid() && _entities);
+	// Disabled entities are neither drawn nor collided, see
+	// MainState::checkHitEvents().
+	entity.setEnabled(false);
+	_spares.push_back(entity);
+}
+
+
+EntityRef EntityPool::clone() {
+	EntityRef entity = _entities->cloneEntity(_model, _parent,
+	                                          _name.empty()? nullptr: _name.c_str());
+	entity.setEnabled(false);
+	return entity;
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_ENTITY_POOL_H_
+#define KITTEN_KEEPER_ENTITY_POOL_H_
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include <lair/ec/entity.h>
+#include <lair/ec/entity_manager.h>
+
+
+using namespace lair;
+
+
+// Disabled clones of a model, kept under the layer they are used in so that
+// spawning does not clone entities in the middle of a busy tick. Entities
+// given back with release() are reused; the caller resets their components
+// (MainState::createToy() for toys, KittenComponentManager::resetKitten() for
+// kittens retired by MainState::retireCorpses()).
+class EntityPool {
+public:
+	EntityPool();
+	EntityPool(const EntityPool&) = delete;
+	EntityPool(EntityPool&&)      = delete;
+	~EntityPool() = default;
+
+	EntityPool& operator=(const EntityPool&) = delete;
+	EntityPool& operator=(EntityPool&&)      = delete;
+
+	unsigned nSpares() const { return _spares.size(); }
+
+	// Forget the spares (they are destroyed with their parent) and start
+	// cloning model under parent, keeping up to target spares.
+	void reset(EntityManager* entities, EntityRef model, EntityRef parent,
+	           const char* name, unsigned target);
+
+	// Clone at most one spare if below target, to spread the cost over ticks.
+	void refill();
+	void reserve(unsigned count);
+
+	// Enabled entity, either a spare or a new clone.
+	EntityRef acquire();
+	void release(EntityRef entity);
+
+protected:
+	EntityRef clone();
+
+protected:
+	EntityManager*         _entities;
+	EntityRef              _model;
+	EntityRef              _parent;
+	String                 _name;
+	unsigned               _target;
+	std::vector<EntityRef> _spares;
+};
+
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cmath>
+
+#include "level.h"
+
+#include "flow_field.h"
+
+
+static const Vector2i neighbors[] = {
+    Vector2i( 1,  0),
+    Vector2i(-1,  0),
+    Vector2i( 0,  1),
+    Vector2i( 0, -1),
+};
+
+
+FlowField::FlowField()
+    : _level(nullptr)
+    , _width(0)
+    , _height(0)
+{
+}
+
+
+void FlowField::reset(const Level* level) {
+	_level  = level;
+	_width  = level? level->widthInTiles():  0;
+	_height = level? level->heightInTiles(): 0;
+	clear();
+}
+
+
+void FlowField::clear() {
+	_distance.assign(_width * _height, UNREACHABLE);
+	_target.assign(_width * _height, 0);
+	_targets.clear();
+	_queue.clear();
+}
+
+
+void FlowField::seed(const AlignedBox2& box, const Vector2& target) {
+	unsigned ti = _targets.size();
+	_targets.push_back(target);
+
+	// Same cell range as Level::hitTest.
+	Vector2i begin(std::floor(box.min()(0) / TILE_SIZE),
+	               _height - std::ceil (box.max()(1) / TILE_SIZE));
+	Vector2i end  (std::ceil (box.max()(0) / TILE_SIZE),
+	               _height - std::floor(box.min()(1) / TILE_SIZE));
+	begin = begin.cwiseMax(Vector2i(0, 0));
+	end   = end  .cwiseMin(Vector2i(_width, _height));
+
+	for(int y = begin(1); y < end(1); ++y) {
+		for(int x = begin(0); x < end(0); ++x) {
+			unsigned ci = y * _width + x;
+			if(_distance[ci] != 0 && !_level->isSolidCell(x, y)) {
+				_distance[ci] = 0;
+				_target[ci]   = ti;
+				_queue.push_back(ci);
+			}
+		}
+	}
+}
+
+
+void FlowField::propagate() {
+	// Plain BFS, that only lowers distances so it also works incrementally.
+	for(unsigned qi = 0; qi < _queue.size(); ++qi) {
+		unsigned ci = _queue[qi];
+		Vector2i c(ci % _width, ci / _width);
+		unsigned dist = _distance[ci] + 1;
+
+		for(const Vector2i& offset: neighbors) {
+			Vector2i n = c + offset;
+			if(!inside(n) || _level->isSolidCell(n(0), n(1)))
+				continue;
+
+			unsigned ni = n(1) * _width + n(0);
+			if(dist < _distance[ni]) {
+				_distance[ni] = dist;
+				_target[ni]   = _target[ci];
+				_queue.push_back(ni);
+			}
+		}
+	}
+	_queue.clear();
+}
+
+
+void FlowField::addSource(const AlignedBox2& box, const Vector2& target) {
+	seed(box, target);
+	propagate();
+}
+
+
+Vector2i FlowField::cell(const Vector2& pos) const {
+	return Vector2i(std::floor(pos(0) / TILE_SIZE),
+	                _height - 1 - std::floor(pos(1) / TILE_SIZE));
+}
+
+
+Vector2 FlowField::cellCenter(const Vector2i& cell) const {
+	return Vector2(cell(0) + .5f, _height - cell(1) - .5f) * TILE_SIZE;
+}
+
+
+unsigned FlowField::distance(const Vector2i& cell) const {
+	if(!inside(cell))
+		return UNREACHABLE;
+	return _distance[cell(1) * _width + cell(0)];
+}
+
+
+const Vector2& FlowField::target(const Vector2i& cell) const {
+	lairAssert(distance(cell) != UNREACHABLE);
+	return _targets[_target[cell(1) * _width + cell(0)]];
+}
+
+
+Vector2i FlowField::next(const Vector2i& cell) const {
+	unsigned dist = distance(cell);
+	if(dist == 0 || dist == UNREACHABLE)
+		return cell;
+
+	for(const Vector2i& offset: neighbors) {
+		Vector2i n = cell + offset;
+		if(distance(n) == dist - 1)
+			return n;
+	}
+
+	lairAssert(false);
+	return cell;
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_FLOW_FIELD_H_
+#define KITTEN_KEEPER_FLOW_FIELD_H_
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+class Level;
+
+
+// Distance in tiles from every free cell of a level to the closest source,
+// 4-connected. Each cell also remembers the target point of that source, so
+// following next() from anywhere leads to target().
+//
+// Sources can be added incrementally, removing one requires a clear() and
+// re-adding the others.
+class FlowField {
+public:
+	enum {
+		UNREACHABLE = unsigned(-1),
+	};
+
+public:
+	FlowField();
+	FlowField(const FlowField&)  = delete;
+	FlowField(      FlowField&&) = default;
+	~FlowField() = default;
+
+	FlowField& operator=(const FlowField&)  = delete;
+	FlowField& operator=(      FlowField&&) = default;
+
+	void reset(const Level* level);
+	void clear();
+
+	// Seed all the free cells overlapping box, call propagate() afterward.
+	void seed(const AlignedBox2& box, const Vector2& target);
+	void propagate();
+	void addSource(const AlignedBox2& box, const Vector2& target);
+
+	Vector2i cell(const Vector2& pos) const;
+	Vector2  cellCenter(const Vector2i& cell) const;
+
+	unsigned       distance(const Vector2i& cell) const;
+	const Vector2& target(const Vector2i& cell) const;
+	Vector2i       next(const Vector2i& cell) const;
+
+protected:
+	inline bool inside(const Vector2i& cell) const {
+		return cell(0) >= 0 && cell(0) < _width && cell(1) >= 0 && cell(1) < _height;
+	}
+
+protected:
+	const Level* _level;
+	int          _width;
+	int          _height;
+
+	std::vector<unsigned> _distance;
+	std::vector<unsigned> _target;
+	std::vector<Vector2>  _targets;
+	std::vector<unsigned> _queue;
+};
+
+
+#endif
@@ -19,6 +19,9 @@
  */
 
 
+#include <cstdlib>
+#include <cstring>
+
 #include <lair/core/property.h>
 
 #include <lair/render_gl3/texture_set.h>
@@ -32,11 +35,39 @@
 
 
 GameConfig::GameConfig()
-	: GameConfigBase()
+	: GameConfigBase(),
+      headless(false),
+      headlessTicks(0),
+      seed(0),
+      threads(0),
+      profilePath(),
+      corpseTime(60)
 {
 }
 
 void GameConfig::setFromArgs(int& argc, char** argv) {
+	// Consume our own options so that the remaining arguments (the level
+	// path) keep their position.
+	int nArgs = 1;
+	for(int ai = 1; ai < argc; ++ai) {
+		const char* arg = argv[ai];
+		if(std::strcmp(arg, "--headless") == 0)
+			headless = true;
+		else if(std::strncmp(arg, "--ticks=", 8) == 0)
+			headlessTicks = std::strtoull(arg + 8, nullptr, 10);
+		else if(std::strncmp(arg, "--seed=", 7) == 0)
+			seed = std::strtoull(arg + 7, nullptr, 10);
+		else if(std::strncmp(arg, "--threads=", 10) == 0)
+			threads = std::strtoul(arg + 10, nullptr, 10);
+		else if(std::strncmp(arg, "--profile=", 10) == 0)
+			profilePath = arg + 10;
+		else if(std::strncmp(arg, "--corpse-time=", 14) == 0)
+			corpseTime = std::strtof(arg + 14, nullptr);
+		else
+			argv[nArgs++] = argv[ai];
+	}
+	argc = nArgs;
+
 	GameConfigBase::setFromArgs(argc, argv);
 }
 
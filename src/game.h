@@ -43,6 +43,22 @@ public:
 
 	static const PropertyList& staticProperties();
 
+public:
+	// Run MainState without rendering, as fast as possible (--headless).
+	bool   headless;
+	// Stop after this many ticks in headless mode, 0 means never (--ticks=N).
+	uint64 headlessTicks;
+	// Seed of the simulation, 0 picks one from the clock (--seed=N).
+	uint64 seed;
+	// Threads used to update kittens, 0 means one per core (--threads=N).
+	unsigned threads;
+	// CSV file written by the profiler, on F4 or at the end of a headless
+	// run. Empty means profile.csv on F4 only (--profile=FILE).
+	String profilePath;
+	// Seconds a dead kitten stays in the colony before it is removed, 0
+	// means forever (--corpse-time=SEC).
+	float corpseTime;
+
 private:
 };
 
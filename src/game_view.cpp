@@ -29,6 +29,8 @@ using namespace lair;
 
 GameView::GameView(Gui* gui, Widget* parent)
     : Widget(gui, parent)
+    , _screenToSceneScale(Vector2(1, 1))
+    , _screenToSceneOffset(Vector2(0, 0))
 {
 }
 
@@ -40,12 +42,25 @@ void GameView::setMainState(MainState* mainState) {
 	_mainState = mainState;
 }
 
+void GameView::updateViewTransform() {
+	// Screen positions are normalized to [-1, 1], then the camera transform,
+	// a scale and a translation, is inverted.
+	const Matrix4& viewTrans = _mainState->_camera.transform();
+	Vector2 viewScale(viewTrans(0, 0), viewTrans(1, 1));
+	Vector2 viewOffset = viewTrans.block<2, 1>(0, 3);
+
+	_screenToSceneScale  = Vector2(2, 2).cwiseQuotient(
+	                           _gui->logicScreenSize().cwiseProduct(viewScale));
+	_screenToSceneOffset = (Vector2(-1, -1) - viewOffset).cwiseQuotient(viewScale);
+}
+
 lair::Vector2 GameView::sceneFromScreen(lair::Vector2 screen) const {
-	Vector4 normalized;
-	normalized << screen.cwiseQuotient(_gui->logicScreenSize()) * 2 - Vector2(1, 1), 0, 1;
-	Matrix4 viewTrans = _mainState->_camera.transform();
-	return viewTrans.partialPivLu().solve(normalized).head<2>();
-	return Vector2();
+	return screen.cwiseProduct(_screenToSceneScale) + _screenToSceneOffset;
+}
+
+void GameView::sceneFromScreen(Vector2* scene, const Vector2* screen, unsigned count) const {
+	for(unsigned i = 0; i < count; ++i)
+		scene[i] = screen[i].cwiseProduct(_screenToSceneScale) + _screenToSceneOffset;
 }
 
 lair::Vector2 GameView::roundPlacement(const lair::Vector2& p) const {
@@ -59,9 +74,9 @@ bool GameView::canPlaceToy(ToyComponent* toy, const lair::Vector2& scenePos) {
 	bool canPlace = !_mainState->_level->hitTest(box);
 
 	if(canPlace) {
-		std::deque<EntityRef> hits;
-		_mainState->_collisions.hitTest(hits, box, HIT_TOY, toy->entity());
-		canPlace = hits.empty();
+		_hits.clear();
+		_mainState->_collisions.hitTest(_hits, box, HIT_TOY, toy->entity());
+		canPlace = _hits.empty();
 	}
 
 	return canPlace;
@@ -76,8 +91,7 @@ void GameView::createToy(lair::EntityRef& toyModel) {
 	if(_mainState->_state != STATE_PLAY || _mainState->_money < toyComp->cost)
 		return;
 
-	EntityRef toy = _mainState->_entities.cloneEntity(
-	                    toyModel, _mainState->_toyLayer);
+	EntityRef toy = _mainState->createToy(toyModel);
 	Vector2 scenePos = sceneFromScreen(_gui->lastMousePosition());
 	_mainState->_gameView->beginGrab(toy, scenePos);
 }
@@ -108,6 +122,11 @@ void GameView::beginGrab(EntityRef& entity, const Vector2& scenePos) {
 	toy->startState = toy->state;
 	toy->startPos   = _grabEntity.position2();
 	toy->state      = ToyComponent::DRAGGED;
+	_mainState->_toys.dropUsers(*toy);
+
+	// Kittens should stop walking toward a toy in the air.
+	if(toy->startState != ToyComponent::NONE)
+		_mainState->_toys.invalidateFlowField(toy->type);
 
 	grabMouse();
 	moveGrabbed(scenePos);
@@ -156,6 +175,7 @@ void GameView::endGrab() {
 			_mainState->setMoney(_mainState->_money - toy->cost);
 		toy->state = ToyComponent::PLACED;
 		sprite->setColor(Vector4(1, 1, 1, 1));
+		_mainState->_toys.addToFlowField(*toy);
 	}
 	else {
 		// TODO: Some noise.
@@ -177,13 +197,16 @@ void GameView::cancelGrab() {
 	lairAssert(toy && sprite);
 
 	if(toy->startState == ToyComponent::NONE) {
-		_grabEntity.destroy();
+		_mainState->recycleToy(_grabEntity);
 	}
 	else {
-		toy->state = toy->startState;
+		// Its users were dropped by beginGrab() and get off it before any
+		// kitten can use it again, so it is free.
+		toy->state = ToyComponent::PLACED;
 		_grabEntity.placeAt(toy->startPos);
 		sprite->setColor(Vector4(1, 1, 1, 1));
 		_mainState->_collisions.update(_grabEntity);
+		_mainState->_toys.addToFlowField(*toy);
 	}
 
 	releaseMouse();
@@ -192,10 +215,12 @@ void GameView::cancelGrab() {
 
 void GameView::mousePressEvent(MouseEvent& event) {
 	if(!_grabEntity.isValid() && event.button() == MOUSE_LEFT) {
-		std::deque<EntityRef> hits;
 		Vector2 scenePos = sceneFromScreen(event.position());
-		_mainState->_collisions.hitTest(hits, scenePos, HIT_TOY);
-		for(EntityRef entity: hits) {
+		_hits.clear();
+		_mainState->_collisions.hitTest(_hits, scenePos, HIT_TOY);
+		if(!_hits.empty()) {
+			// beginGrab reuses _hits.
+			EntityRef entity = _hits.front();
 			beginGrab(entity, scenePos);
 			event.accept();
 			return;
@@ -22,6 +22,7 @@
 #ifndef LD_40_GAME_VIEW_H_
 #define LD_40_GAME_VIEW_H_
 
+#include <deque>
 #include <vector>
 
 #include <lair/core/lair.h>
@@ -45,7 +46,12 @@ public:
 
 	void setMainState(MainState* mainState);
 
+	// Must be called when the camera or the logic screen size change.
+	void updateViewTransform();
+
 	lair::Vector2 sceneFromScreen(lair::Vector2 screen) const;
+	void sceneFromScreen(lair::Vector2* scene, const lair::Vector2* screen,
+	                     unsigned count) const;
 
 	lair::Vector2 roundPlacement(const lair::Vector2& p) const;
 	bool canPlaceToy(ToyComponent* toy, const lair::Vector2& scenePos);
@@ -65,6 +71,14 @@ protected:
 	MainState* _mainState;
 
 	lair::EntityRef _grabEntity;
+
+	// The camera is orthographic, so unprojecting a screen position is a
+	// scale and an offset.
+	lair::Vector2 _screenToSceneScale;
+	lair::Vector2 _screenToSceneOffset;
+
+	// Reused by hit tests to avoid allocating on every mouse move.
+	std::deque<lair::EntityRef> _hits;
 };
 
 
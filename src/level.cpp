@@ -64,6 +64,9 @@ Box2 flipY(const Box2& box, float height) {
 Level::Level(MainState* mainState, const Path& path)
 	: _mainState(mainState)
 	, _path(path)
+	, _tileMap(nullptr)
+	, _width(0)
+	, _height(0)
 {
 }
 
@@ -83,6 +86,7 @@ void Level::initialize() {
 	lairAssert(_tileMapAspect && _tileMapAspect->isValid());
 
 	_tileMap = &_tileMapAspect->_get();
+	buildSolidity();
 
 	_entityMap.clear();
 	if(_levelRoot.isValid())
@@ -90,11 +94,7 @@ void Level::initialize() {
 	_levelRoot = _mainState->_entities.createEntity(_mainState->_scene, _path.utf8CStr());
 	_levelRoot.setEnabled(false);
 
-	TileLayerCSP tileLayer = _tileMap->tileLayer(_tileMap->nLayers() - 1);
-	_mainState->_collisions.setBounds(
-	            AlignedBox2(Vector2(0, 0),
-	                        Vector2(tileLayer->widthInTiles()  * TILE_SIZE,
-	                                tileLayer->heightInTiles() * TILE_SIZE)));
+	_mainState->_collisions.setBounds(bounds());
 
 	_baseLayer = createLayer(_tileMap->nLayers() - 1, "layer_base");
 	_objects = _mainState->_entities.createEntity(_levelRoot, "objects");
@@ -155,43 +155,80 @@ void Level::stop() {
 }
 
 
+AlignedBox2 Level::bounds() const {
+	TileLayerCSP tileLayer = _tileMap->tileLayer(_tileMap->nLayers() - 1);
+	return AlignedBox2(Vector2(0, 0),
+	                   Vector2(tileLayer->widthInTiles()  * TILE_SIZE,
+	                           tileLayer->heightInTiles() * TILE_SIZE));
+}
+
+
 TileMap::TileIndex Level::getTile (const Vector2& pos) const {
-	TileLayerCSP tileLayer = _tileMap->tileLayer(0);
+	Vector2i tilexy = cellCoord(pos, _height);
 
-	Vector2i tilexy = cellCoord(pos, tileLayer->heightInTiles());
-	
-	if(tilexy(0) >= 0 && unsigned(tilexy(0)) < tileLayer->widthInTiles()
-	&& tilexy(1) >= 0 && unsigned(tilexy(1)) < tileLayer->heightInTiles())
-		return tileLayer->tile(tilexy[0], tilexy[1]);
+	if(tilexy(0) >= 0 && tilexy(0) < _width
+	&& tilexy(1) >= 0 && tilexy(1) < _height)
+		return _tiles[tilexy(1) * _width + tilexy(0)];
 	return 0;
 }
 
 
 bool Level::inSolid (const Vector2& pos) const {
-	return isSolid(getTile(pos));
+	Vector2i tilexy = cellCoord(pos, _height);
+
+	// Outside of the map is not solid here, unlike in hitTest.
+	if(tilexy(0) >= 0 && tilexy(0) < _width
+	&& tilexy(1) >= 0 && tilexy(1) < _height)
+		return isSolidCell(tilexy(0), tilexy(1));
+	return false;
 }
 
 
 bool Level::hitTest(const AlignedBox2& box) const {
-	TileLayerCSP tileLayer = _tileMap->tileLayer(0);
-
-	int width  = tileLayer->widthInTiles();
-	int height = tileLayer->heightInTiles();
 	Vector2i begin(std::floor(box.min()(0) / TILE_SIZE),
-	               height - std::ceil (box.max()(1) / TILE_SIZE));
+	               _height - std::ceil (box.max()(1) / TILE_SIZE));
 	Vector2i end  (std::ceil (box.max()(0) / TILE_SIZE),
-	               height - std::floor(box.min()(1) / TILE_SIZE));
-
-	for(int y = begin(1); y < end(1); ++y) {
-		for(int x = begin(0); x < end(0); ++x) {
-			if(x < 0 || x >= width || y < 0 || y >= height
-			|| isSolid(tileLayer->tile(x, y))) {
-				return true;
-			}
+	               _height - std::floor(box.min()(1) / TILE_SIZE));
+
+	if(begin(0) >= end(0) || begin(1) >= end(1))
+		return false;
+	if(begin(0) < 0 || end(0) > _width || begin(1) < 0 || end(1) > _height)
+		return true;
+
+	unsigned stride = _width + 1;
+	unsigned count = _solidSum[end  (1) * stride + end  (0)]
+	               - _solidSum[begin(1) * stride + end  (0)]
+	               - _solidSum[end  (1) * stride + begin(0)]
+	               + _solidSum[begin(1) * stride + begin(0)];
+	return count != 0;
+}
+
+
+void Level::buildSolidity() {
+	TileLayerCSP tileLayer = _tileMap->tileLayer(0);
+
+	_width  = tileLayer->widthInTiles();
+	_height = tileLayer->heightInTiles();
+
+	_tiles.resize(_width * _height);
+	_solidBits.assign((_width * _height + 63) / 64, 0);
+	_solidSum.assign((_width + 1) * (_height + 1), 0);
+
+	unsigned stride = _width + 1;
+	for(int y = 0; y < _height; ++y) {
+		unsigned rowSum = 0;
+		for(int x = 0; x < _width; ++x) {
+			unsigned i = y * _width + x;
+			_tiles[i] = tileLayer->tile(x, y);
+
+			bool solid = isSolid(_tiles[i]);
+			if(solid)
+				_solidBits[i / 64] |= uint64(1) << (i % 64);
+
+			rowSum += solid;
+			_solidSum[(y + 1) * stride + x + 1] = _solidSum[y * stride + x + 1] + rowSum;
 		}
 	}
-
-	return false;
 }
 
 
@@ -25,6 +25,7 @@
 
 #include <memory>
 #include <map>
+#include <vector>
 
 #include <lair/core/lair.h>
 #include <lair/core/path.h>
@@ -86,13 +87,30 @@ public:
 	void start();
 	void stop();
 
+	AlignedBox2 bounds() const;
+	int widthInTiles() const { return _width; }
+	int heightInTiles() const { return _height; }
+
 	TileMap::TileIndex getTile (const Vector2& pos) const;
 	bool inSolid (const Vector2& pos) const;
 	bool hitTest(const AlignedBox2& box) const;
 
+	// Cell coordinates, y going down as in the tile layer. Out of the map is solid.
+	inline bool isSolidCell(int x, int y) const {
+		if(x < 0 || x >= _width || y < 0 || y >= _height)
+			return true;
+		unsigned i = y * _width + x;
+		return (_solidBits[i / 64] >> (i % 64)) & 1u;
+	}
+
 	Box2 objectBox(const Json::Value& obj) const;
 
 	EntityRef createLayer(unsigned index, const char* name);
+
+protected:
+	void buildSolidity();
+
+public:
 //	EntityRef createTrigger(const Json::Value& obj, const std::string& name);
 //	EntityRef createItem(const Json::Value& obj, const std::string& name);
 //	EntityRef createDoor(const Json::Value& obj, const std::string& name);
@@ -113,6 +131,14 @@ protected:
 	TileMapAspectSP _tileMapAspect;
 	TileMap*   _tileMap;
 
+	// Copy of the collision layer (tile layer 0), packed solidity bits and
+	// summed-area table of the solid cells ((_width + 1) * (_height + 1)).
+	int                _width;
+	int                _height;
+	std::vector<TileMap::TileIndex> _tiles;
+	std::vector<uint64> _solidBits;
+	std::vector<unsigned> _solidSum;
+
 	EntityRef  _levelRoot;
 	EntityRef  _baseLayer;
 	EntityRef  _objects;
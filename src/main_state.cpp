@@ -19,6 +19,8 @@
  */
 
 
+#include <algorithm>
+#include <ctime>
 #include <functional>
 
 #include <lair/core/json.h>
@@ -41,6 +43,18 @@ const float TICK_LENGTH_IN_SEC = 1.f / float(TICKS_PER_SEC);
 const float FADE_DURATION = .5;
 const float KITTEN_TIME = 20;
 
+// Spares cloned at level start, then topped up one per tick.
+const unsigned KITTEN_POOL_SIZE = 32;
+const unsigned TOY_POOL_SIZE    = 4;
+
+// Arguments of a command, including its name.
+const unsigned MAX_CMD_ARGS = 32;
+
+// Commands are echoed to the debug log only if it shows info messages.
+static bool logCommands() {
+	return dbgLogger.level() >= LogLevel::Info;
+}
+
 void dumpEntityTree(Logger& log, EntityRef e, unsigned indent = 0) {
 	log.info(std::string(indent * 2u, ' '), e.name(), ": ", e.isEnabled(), ", ", e.position3().transpose());
 	EntityRef c = e.firstChild();
@@ -76,10 +90,23 @@ MainState::MainState(Game* game)
 
       _initialized(false),
       _running(false),
+      _headless(false),
       _loop(sys()),
+      _tickCount(0),
+      _seed(0),
+      _rng(),
+      _workers(),
+      _simThread(),
+      _kittensPending(false),
+      _kittensBackgroundNs(0),
+      _profiler(),
       _fpsTime(0),
       _fpsCount(0),
 
+      _triggerOccupants(),
+      _triggerHits(),
+      _nextOccupancyId(0),
+
       _quitInput(nullptr),
       _leftInput(nullptr),
       _rightInput(nullptr),
@@ -91,8 +118,17 @@ MainState::MainState(Game* game)
       _litterInput(nullptr),
       _medecineInput(nullptr),
       _basketInput(nullptr),
+      _profileInput(nullptr),
+      _profileDumpInput(nullptr),
 
       _state(STATE_PLAY),
+      _happiness(1),
+      _money(0),
+      _spawnCount(0),
+      _deathCount(0),
+      _catCounts(Vector2i(0, 0)),
+      _colonyTicks(0),
+      _corpses(),
 
       _gameView(nullptr),
       _menu(nullptr),
@@ -107,7 +143,8 @@ MainState::MainState(Game* game)
       _toyButtonPos(8, 8),
       _dialog(nullptr),
       _dialogText(nullptr),
-      _dialogButton(nullptr)
+      _dialogButton(nullptr),
+      _profileLabel(nullptr)
 {
 	_entities.registerComponentManager(&_sprites);
 	_entities.registerComponentManager(&_collisions);
@@ -124,7 +161,15 @@ MainState::~MainState() {
 
 
 void MainState::initialize() {
-	srand(time(nullptr));
+	_headless = game()->config().headless;
+
+	_seed = game()->config().seed;
+	if(!_seed)
+		_seed = time(nullptr);
+	log().info("Random seed: ", _seed);
+
+	_workers.start(game()->config().threads);
+	log().info("Update threads: ", _workers.nThreads());
 
 	_loop.reset();
 	_loop.setTickDuration(    ONE_SEC /  TICKS_PER_SEC);
@@ -147,6 +192,8 @@ void MainState::initialize() {
 	_litterInput   = _inputs.addInput("litter");
 	_medecineInput = _inputs.addInput("medecine");
 	_basketInput   = _inputs.addInput("basket");
+	_profileInput     = _inputs.addInput("profile");
+	_profileDumpInput = _inputs.addInput("profile_dump");
 
 	_inputs.mapScanCode(_quitInput,  SDL_SCANCODE_ESCAPE);
 	_inputs.mapScanCode(_leftInput,  SDL_SCANCODE_LEFT);
@@ -163,6 +210,9 @@ void MainState::initialize() {
 	_inputs.mapScanCode(_medecineInput, SDL_SCANCODE_R);
 	_inputs.mapScanCode(_basketInput,   SDL_SCANCODE_T);
 
+	_inputs.mapScanCode(_profileInput,     SDL_SCANCODE_F3);
+	_inputs.mapScanCode(_profileDumpInput, SDL_SCANCODE_F4);
+
 	// TODO: load stuff.
 	loadEntities("entities.ldl", _entities.root());
 
@@ -196,6 +246,7 @@ void MainState::initialize() {
 	_gameView = _gui.createWidget<GameView>();
 	_gameView->setMainState(this);
 	_gameView->setName("game_view");
+	updateCamera();
 
 	_menu = _gui.createWidget<Widget>();
 	_menu->setName("menu");
@@ -242,6 +293,18 @@ void MainState::initialize() {
 	_catLabel->place(_toyButtonPos + Vector2(0, 80 - _catLabel->size()(1)) / 2);
 	_toyButtonPos(0) += _catLabel->size()(0) + 32;
 
+	// Labels are only formatted again when what they show changes.
+	_happiness.subscribe([](float happiness) { return std::round(happiness * 100); },
+	                     [this](float happiness) {
+		_happinessLabel->setText(cat("Happiness: ", std::round(happiness * 100), "%"));
+	});
+	_money.subscribe([this](int money) {
+		_moneyLabel->setText(cat("Money: ", money, "$"));
+	});
+	_catCounts.subscribe([this](const Vector2i& counts) {
+		_catLabel->setText(cat("Cats: ", counts(0), ", Deaths: ", counts(1)));
+	});
+
 	_dialog = _gui.createWidget<Widget>();
 	_dialog->setEnabled(false);
 	_dialog->setFrameTexture("frame.png");
@@ -267,6 +330,16 @@ void MainState::initialize() {
 		e.accept();
 	};
 
+	_profileLabel = _gui.createWidget<Label>();
+	_profileLabel->setName("profile");
+	_profileLabel->setEnabled(false);
+	_profileLabel->setFrameTexture("white.png");
+	_profileLabel->setFrameColor(srgba(0, 0, 0, .6));
+	_profileLabel->setFont(font);
+	_profileLabel->textInfo().setColor(srgba(1, 1, 1, 1));
+	_profileLabel->setMargin(8);
+	updateProfileLabel(0);
+
 	loader()->waitAll();
 
 	// Set to true to debug OpenGL calls
@@ -288,12 +361,23 @@ void MainState::run() {
 
 	log().log("Starting main state...");
 	_running = true;
+	_tickCount = 0;
+
+	if(_headless) {
+		runHeadless();
+		return;
+	}
+
 	_loop.start();
 	_fpsTime  = int64(sys()->getTimeNs());
 	_fpsCount = 0;
 
 	startGame();
 
+	// The kitten update gets its own thread when there is a core to spare.
+	if(_workers.nThreads() > 1)
+		_simThread.start();
+
 	do {
 		switch(_loop.nextEvent()) {
 		case InterpLoop::Tick:
@@ -304,20 +388,51 @@ void MainState::run() {
 			break;
 		}
 	} while (_running);
+	_simThread.stop();
+	_kittensPending = false;
 	_loop.stop();
 }
 
 
-void MainState::exec(const std::string& cmds, EntityRef self) {
-	CommandList commands;
-	unsigned first = 0;
-	for(unsigned ci = 0; ci <= cmds.size(); ++ci) {
-		if(ci == cmds.size() || cmds[ci] == '\n' || cmds[ci] == ';') {
-			commands.emplace_back(CommandExpr{ String(cmds.begin() + first, cmds.begin() + ci), self });
-			first = ci + 1;
+void MainState::runHeadless() {
+	uint64 maxTicks = game()->config().headlessTicks;
+	log().info("Headless mode: ", maxTicks? cat(maxTicks, " ticks"): String("no tick limit"));
+
+	startGame();
+
+	int64  startTime   = int64(sys()->getTimeNs());
+	int64  reportTime  = startTime;
+	uint64 reportTicks = 0;
+	while(_running && (maxTicks == 0 || _tickCount < maxTicks)) {
+		updateTick();
+
+		int64 now = int64(sys()->getTimeNs());
+		int64 etime = now - reportTime;
+		if(etime >= ONE_SEC) {
+			log().info("Ticks/s: ", (_tickCount - reportTicks) * float(ONE_SEC) / etime,
+			           ", kittens: ", _spawnCount - _deathCount);
+			reportTime  = now;
+			reportTicks = _tickCount;
 		}
 	}
-	exec(commands);
+
+	int64 etime = std::max(int64(sys()->getTimeNs()) - startTime, int64(1));
+	log().info("Simulated ", _tickCount, " ticks (", _tickCount / float(TICKS_PER_SEC),
+	           "s of colony time) in ", etime / float(ONE_SEC), "s: ",
+	           _tickCount * float(ONE_SEC) / etime, " ticks/s");
+	log().info("Cats: ", _spawnCount - _deathCount, ", Deaths: ", _deathCount,
+	           ", Money: ", _money.get(), ", Happiness: ", _happiness.get());
+
+	_profiler.startTick();
+	log().info("Tick times (min / avg / p99 of the last ", _profiler.historySize(), "):\n",
+	           _profiler.report());
+	if(!game()->config().profilePath.empty())
+		dumpProfile(game()->config().profilePath);
+}
+
+
+void MainState::exec(const std::string& cmds, EntityRef self) {
+	exec(compile(cmds), self);
 }
 
 
@@ -333,15 +448,15 @@ void MainState::execNext() {
 	while(!_commandList.empty()) {
 		CommandExpr cmd = _commandList.front();
 		_commandList.pop_front();
-		if(execSingle(cmd.command, cmd.self) == 0)
+		int ret = cmd.program? execCall(*cmd.program, cmd.call, cmd.self):
+		                       execSingle(cmd.command, cmd.self);
+		if(ret == 0)
 			return;
 	}
 }
 
 
 int MainState::execSingle(const std::string& cmd, EntityRef self) {
-#define MAX_CMD_ARGS 32
-
 	std::string tokens = cmd;
 	unsigned    size   = tokens.size();
 	int ret = 0;
@@ -378,11 +493,13 @@ int MainState::execSingle(const std::string& cmd, EntityRef self) {
 int MainState::exec(int argc, const char** argv, EntityRef self) {
 	lairAssert(argc > 0);
 
-	std::ostringstream out;
-	out << argv[0];
-	for(int i = 1; i < argc; ++i)
-		out << " " << argv[i];
-	dbgLogger.info(out.str());
+	if(logCommands()) {
+		std::ostringstream out;
+		out << argv[0];
+		for(int i = 1; i < argc; ++i)
+			out << " " << argv[i];
+		dbgLogger.info(out.str());
+	}
 
 	auto cmd = _commands.find(argv[0]);
 	if(cmd == _commands.end()) {
@@ -393,6 +510,101 @@ int MainState::exec(int argc, const char** argv, EntityRef self) {
 }
 
 
+CommandProgramSP MainState::compile(const std::string& cmds) const {
+	std::shared_ptr<CommandProgram> program = std::make_shared<CommandProgram>();
+	program->args.reserve(cmds.size() + 1);
+
+	// Calls are separated by '\n' or ';', arguments by spaces. Empty calls
+	// are dropped.
+	unsigned size     = cmds.size();
+	unsigned firstArg = 0;
+	for(unsigned ci = 0; ci <= size; ++ci) {
+		unsigned argc = program->argOffsets.size() - firstArg;
+
+		if(ci == size || cmds[ci] == '\n' || cmds[ci] == ';') {
+			if(argc) {
+				const char* name = program->args.data() + program->argOffsets[firstArg];
+				auto cmd = _commands.find(name);
+				program->calls.push_back(CommandProgram::Call{
+				    (cmd != _commands.end())? cmd->second: nullptr, firstArg, argc });
+				firstArg = program->argOffsets.size();
+			}
+			continue;
+		}
+		if(std::isspace(cmds[ci]))
+			continue;
+
+		unsigned end = ci;
+		while(end < size && !std::isspace(cmds[end]) && cmds[end] != ';')
+			++end;
+
+		if(argc < MAX_CMD_ARGS) {
+			program->argOffsets.push_back(program->args.size());
+			program->args.append(cmds, ci, end - ci);
+			program->args.push_back('\0');
+		}
+		else {
+			dbgLogger.warning("Too many arguments in \"", cmds, "\"");
+		}
+		ci = end - 1;
+	}
+
+	return program;
+}
+
+
+const CommandProgramSP& MainState::compiled(CommandProgramSP& cache, const std::string& cmds) const {
+	if(!cache)
+		cache = compile(cmds);
+	return cache;
+}
+
+
+void MainState::exec(const CommandProgramSP& program, EntityRef self) {
+	if(!program || program->calls.empty())
+		return;
+
+	// Something is waiting: run the program once it is done, like
+	// exec(CommandList).
+	if(!_commandList.empty()) {
+		for(unsigned call = program->calls.size(); call > 0; --call)
+			_commandList.push_front(CommandExpr{ String(), self, program, call - 1 });
+		return;
+	}
+
+	for(unsigned call = 0; call < program->calls.size(); ++call) {
+		if(execCall(*program, call, self) == 0) {
+			for(unsigned next = program->calls.size(); next > call + 1; --next)
+				_commandList.push_front(CommandExpr{ String(), self, program, next - 1 });
+			return;
+		}
+	}
+}
+
+
+int MainState::execCall(const CommandProgram& program, unsigned call, EntityRef self) {
+	const CommandProgram::Call& c = program.calls[call];
+
+	const char* argv[MAX_CMD_ARGS];
+	for(unsigned ai = 0; ai < c.argc; ++ai)
+		argv[ai] = program.args.data() + program.argOffsets[c.firstArg + ai];
+
+	if(logCommands()) {
+		std::ostringstream out;
+		out << argv[0];
+		for(unsigned ai = 1; ai < c.argc; ++ai)
+			out << " " << argv[ai];
+		dbgLogger.info(out.str());
+	}
+
+	if(!c.command) {
+		dbgLogger.warning("Unknown command \"", argv[0], "\"");
+		return -1;
+	}
+	return c.command(this, self, c.argc, argv);
+}
+
+
 void MainState::quit() {
 	_running = false;
 }
@@ -426,9 +638,24 @@ void MainState::loadLevel(const Path& level) {
 
 	while(_scene.firstChild().isValid())
 		_scene.firstChild().destroy();
+	// The only place kittens and toys are destroyed, see
+	// KittenComponentManager::compact().
+	_kittens.compact();
+	_toys.compact();
+	_colonyTicks = 0;
+	_corpses.clear();
+	// Their triggers and kittens are gone, do not fire on_exit for them.
+	_triggerOccupants.clear();
+	// Commands may have been registered or changed since they were compiled.
+	for(TriggerComponent& trigger: _triggers) {
+		trigger.onEnterProgram.reset();
+		trigger.onExitProgram.reset();
+		trigger.onUseProgram.reset();
+	}
 
 	_level = _levelMap.at(level);
 	_level->initialize();
+	_toys.resetFlowFields();
 
 	EntityRef layer = _entities.findByName("layer_base");
 	auto tileLayer = _tileLayers.get(layer);
@@ -443,6 +670,14 @@ void MainState::loadLevel(const Path& level) {
 	_kittenLayer = _entities.createEntity(_scene, "kitten_layer");
 	_kittenLayer.placeAt(Vector3(0, 0, 0.2));
 
+	_kittenPool.reset(&_entities, _kittenModel, _kittenLayer, "kitten", KITTEN_POOL_SIZE);
+	EntityRef toyModels[] = { _foodModel, _toyModel, _litterModel, _pillModel, _basketModel };
+	for(EntityRef model: toyModels) {
+		ToyComponent* tc = _toys.get(model);
+		lairAssert(tc && tc->type < TOY_TYPE_COUNT);
+		_toyPools[tc->type].reset(&_entities, model, _toyLayer, nullptr, TOY_POOL_SIZE);
+	}
+
 	_level->start();
 }
 
@@ -453,6 +688,9 @@ void MainState::loadSound(const Path& sound) {
 
 
 void MainState::playSound(const Path& sound) {
+	if(_headless)
+		return;
+
 	AssetSP asset = assets()->getAsset(sound);
 	auto aspect = asset->aspect<SoundAspect>();
 	aspect->_get().setVolume(game()->config().soundVolume);
@@ -486,6 +724,9 @@ ToyButton* MainState::createToyButton(EntityRef model, const String& name,
 	button->setDescription(cat(name, "\nCost: ", cost, "$\n\n", description));
 	button->layout();
 
+	_money.subscribe([cost](int money) { return money >= cost; },
+	                 [button, cost](int money) { button->setAffordable(money >= cost); });
+
 	_toyButtonPos(0) += 88;
 
 	return button;
@@ -506,8 +747,12 @@ EntityRef MainState::createTrigger(EntityRef parent, const char* name, const Ali
 
 	CollisionComponent* cc = _collisions.addComponent(entity);
 	cc->addShape(Shape2D(box));
-//	cc->setHitMask(HIT_PLAYER | HIT_TRIGGER);
-//	cc->setIgnoreMask(HIT_TRIGGER);
+	// Shapes hit each other when their hit masks share a bit, so a trigger
+	// takes the HIT_KITTEN bit of the kittens (see entities.ldl) to see
+	// them. HIT_TRIGGER only tags it, and ignoring it keeps overlapping
+	// triggers from hitting each other.
+	cc->setHitMask(HIT_KITTEN | HIT_TRIGGER);
+	cc->setIgnoreMask(HIT_TRIGGER);
 
 	_triggers.addComponent(entity);
 
@@ -515,43 +760,74 @@ EntityRef MainState::createTrigger(EntityRef parent, const char* name, const Ali
 }
 
 
-void MainState::updateTriggers(bool /*disableCmds*/) {
-	// FIXME: Is this useful ?
-//	_triggers.compactArray();
+void MainState::updateTriggers(bool disableCmds) {
+	// Kittens inside triggers, from the hit events of the last
+	// findCollisions().
+	_triggerHits.clear();
+	for(const HitEvent& hit: _collisions.hitEvents()) {
+		EntityRef e0 = hit.entities[0];
+		EntityRef e1 = hit.entities[1];
+		TriggerComponent* tc = _triggers.get(e0);
+		if(!tc) {
+			std::swap(e0, e1);
+			tc = _triggers.get(e0);
+		}
+		KittenComponent* kc = tc? _kittens.get(e1): nullptr;
+		if(!kc || !tc->isEnabled() || !e0.isEnabledRec() || !kc->isEnabled())
+			continue;
+
+		if(!tc->occupancyId)
+			tc->occupancyId = ++_nextOccupancyId;
+		if(!kc->occupancyId)
+			kc->occupancyId = ++_nextOccupancyId;
+		_triggerHits.push_back(TriggerOccupant{ tc->occupancyId, kc->occupancyId, e0, e1 });
+	}
+	std::sort(_triggerHits.begin(), _triggerHits.end());
+	_triggerHits.erase(std::unique(_triggerHits.begin(), _triggerHits.end()),
+	                   _triggerHits.end());
+
+	// Only the differences with the previous tick trigger something. Each
+	// command may change the game, so work on the new set.
+	_triggerOccupants.swap(_triggerHits);
+	auto prev = _triggerHits.begin();
+	auto next = _triggerOccupants.begin();
+	while(prev != _triggerHits.end() || next != _triggerOccupants.end()) {
+		if(next == _triggerOccupants.end() || (prev != _triggerHits.end() && *prev < *next)) {
+			triggerEvent(*prev, false, disableCmds);
+			++prev;
+		}
+		else if(prev == _triggerHits.end() || *next < *prev) {
+			triggerEvent(*next, true, disableCmds);
+			++next;
+		}
+		else {
+			++prev;
+			++next;
+		}
+	}
+}
 
-//	for(TriggerComponent& tc: _triggers) {
-//		if(tc.isEnabled() && tc.entity().isEnabledRec()) {
-//			tc.prevInside = tc.inside;
-//			tc.inside = false;
-//		}
-//	}
+void MainState::triggerEvent(const TriggerOccupant& occupant, bool enter, bool disableCmds) {
+	if(disableCmds || !occupant.triggerEntity.isValid())
+		return;
 
-//	for(HitEvent hit: _collisions.hitEvents()) {
-//		if(hit.entities[1] == _player) {
-//			std::swap(hit.entities[0], hit.entities[1]);
-//		}
+	TriggerComponent* tc = _triggers.get(occupant.triggerEntity);
+	if(!tc)
+		return;
 
-//		if(hit.entities[0] == _player) {
-//			TriggerComponent* tc = _triggers.get(hit.entities[1]);
-//			if(tc) {
-//				tc->inside = true;
-//			}
-//		}
-//	}
-
-//	if(!disableCmds) {
-//		for(TriggerComponent& tc: _triggers) {
-//			if(tc.isEnabled() && tc.entity().isEnabledRec()) {
-//				if(!tc.prevInside && tc.inside && !tc.onEnter.empty())
-//					exec(tc.onEnter, tc.entity());
-//				if(tc.prevInside && !tc.inside && !tc.onExit.empty())
-//					exec(tc.onExit, tc.entity());
-//			}
-//		}
-//	}
+	// The program belongs to the trigger, self is the kitten that entered
+	// or left it.
+	const std::string& cmds = enter? tc->onEnter: tc->onExit;
+	if(!cmds.empty())
+		exec(compiled(enter? tc->onEnterProgram: tc->onExitProgram, cmds),
+		     occupant.kittenEntity);
 }
 
 void MainState::showDialog(const String& message, const String& buttonText, State state) {
+	// Nobody to click on "Continue" in headless mode.
+	if(_headless)
+		return;
+
 	float width = 600;
 	float margin = 16;
 
@@ -579,10 +855,15 @@ void MainState::closeDialog() {
 
 
 void MainState::setHappiness(float happiness) {
-	_happiness = happiness;
-	_happinessLabel->setText(cat("Happiness: ", std::round(_happiness * 100), "%"));
+	_happiness.set(happiness);
 
 	if(_happiness < 0) {
+		if(_headless) {
+			log().warning("Game over after ", _tickCount, " ticks.");
+			quit();
+			return;
+		}
+
 		showDialog("Ho nooo ! Things got so messy we have to close down...\n\nDon't worry, you can try again.", "NOOOoooooo...");
 		_dialogButton->onMouseUp = [this](Widget*, MouseEvent& e) {
 			game()->splashState()->setNextState(nullptr);
@@ -601,25 +882,20 @@ void MainState::setHappiness(float happiness) {
 
 
 void MainState::setMoney(int money) {
-	_money = money;
-	_moneyLabel->setText(cat("Money: ", _money, "$"));
-
-	_foodButton->update();
-	_toyButton->update();
-	_litterButton->update();
-	_pillButton->update();
-	_basketButton->update();
+	_money.set(money);
 }
 
 void MainState::setSpawnDeath(int spawn, int death) {
 	_spawnCount = spawn;
 	_deathCount = death;
-
-	_catLabel->setText(cat("Cats: ", _spawnCount - _deathCount, ", Deaths: ", _deathCount));
+	_catCounts.set(Vector2i(spawn - death, death));
 }
 
 EntityRef MainState::spawnKitten(const Vector2& pos) {
-	EntityRef kitten = _entities.cloneEntity(_kittenModel, _kittenLayer, "kitten");
+	EntityRef kitten = _kittenPool.acquire();
+	KittenComponent* kc = _kittens.get(kitten);
+	_kittens.resetKitten(*kc, *_kittens.get(_kittenModel));
+	kc->rng.setSeed(_rng.nextSeed());
 	setSpawnDeath(_spawnCount + 1, _deathCount);
 	setMoney(_money + 20 * _happiness);
 
@@ -635,8 +911,8 @@ EntityRef MainState::spawnKitten(const Vector2& pos) {
 		AlignedBox2 box;
 		int tries = 0;
 		do {
-			kitten.placeAt(Vector2(rand() % (tileLayer->widthInTiles() * TILE_SIZE),
-			                       rand() % (tileLayer->heightInTiles() * TILE_SIZE)));
+			kitten.placeAt(Vector2(_rng.below(tileLayer->widthInTiles() * TILE_SIZE),
+			                       _rng.below(tileLayer->heightInTiles() * TILE_SIZE)));
 			box = coll->shapes()[0].transformed(kitten.worldTransform()).boundingBox();
 			++tries;
 		} while(_level->hitTest(box) && tries < 10);
@@ -646,11 +922,89 @@ EntityRef MainState::spawnKitten(const Vector2& pos) {
 }
 
 
+EntityRef MainState::placeToy(EntityRef model, const Vector2& pos) {
+	EntityRef toy = createToy(model);
+	ToyComponent* tc = _toys.get(toy);
+
+	Vector2 p = _gameView->roundPlacement(pos);
+	if(!_gameView->canPlaceToy(tc, p)) {
+		recycleToy(toy);
+		return EntityRef();
+	}
+
+	toy.placeAt(p);
+	_collisions.update(toy);
+	tc->state = ToyComponent::PLACED;
+	_toys.addToFlowField(*tc);
+
+	return toy;
+}
+
+
+EntityRef MainState::createToy(EntityRef model) {
+	ToyComponent* mc = _toys.get(model);
+	lairAssert(mc && mc->type < TOY_TYPE_COUNT);
+
+	EntityRef toy = _toyPools[mc->type].acquire();
+	ToyComponent* tc = _toys.get(toy);
+	lairAssert(tc);
+	tc->state      = ToyComponent::NONE;
+	tc->startState = ToyComponent::NONE;
+	tc->users      = 0;
+
+	// A recycled toy keeps the tint of its last drag.
+	SpriteComponent* sprite = _sprites.get(toy);
+	if(sprite)
+		sprite->setColor(Vector4(1, 1, 1, 1));
+
+	return toy;
+}
+
+
+void MainState::recycleToy(EntityRef toy) {
+	ToyComponent* tc = _toys.get(toy);
+	lairAssert(tc && tc->type < TOY_TYPE_COUNT);
+
+	// Kittens still pointing to it must not take the reused toy for the same.
+	++tc->placement;
+	tc->state = ToyComponent::NONE;
+	_toyPools[tc->type].release(toy);
+}
+
+
+void MainState::addCorpse(EntityRef kitten) {
+	float corpseTime = game()->config().corpseTime;
+	if(corpseTime <= 0)
+		return;
+
+	_corpses.push_back(Corpse{ kitten, _colonyTicks + uint64(corpseTime * TICKS_PER_SEC) });
+}
+
+
+void MainState::retireCorpses() {
+	// Corpses are queued in death order and all stay the same time. Once
+	// disabled, the sprite pass skips them as it skips the hidden bubbles
+	// and the models, and collisions ignore them (see checkHitEvents()).
+	while(!_corpses.empty() && _corpses.front().retireTick <= _colonyTicks) {
+		_kittenPool.release(_corpses.front().kitten);
+		_corpses.pop_front();
+	}
+}
+
+
+void MainState::checkHitEvents() {
+#ifndef NDEBUG
+	for(const HitEvent& hit: _collisions.hitEvents())
+		lairAssert(hit.entities[0].isEnabledRec() && hit.entities[1].isEnabledRec());
+#endif
+}
+
+
 void MainState::startGame() {
+	_rng.setSeed(_seed);
 	loadLevel(_levelPath);
 
-	_spawnCount = 0;
-	_deathCount = 0;
+	setSpawnDeath(0, 0);
 
 	setHappiness(1);
 	setMoney(50);
@@ -675,16 +1029,43 @@ void MainState::startGame() {
 
 
 void MainState::updateTick() {
-	loader()->finalizePending();
+	_profiler.startTick();
+	ProfileScope profileTick(_profiler, PROF_TICK);
 
-	_inputs.sync();
+	++_tickCount;
+
+	loader()->finalizePending();
 
 	_entities.setPrevWorldTransforms();
 
+	// Frames rendered since the previous tick showed the state before its
+	// kitten update, so entities move from there to the end of that tick.
+	if(_kittensPending) {
+		{
+			ProfileScope profile(_profiler, PROF_KITTENS_WAIT);
+			_simThread.wait();
+		}
+		// Kitten cost is the same whether it overlapped rendering or not,
+		// kittens_wait tells how much of it the overlap did not hide.
+		_profiler.add(PROF_KITTENS, _kittensBackgroundNs);
+		_kittensPending = false;
+		endPlayTick();
+	}
+
+	_inputs.sync();
+	_gui.dispatchPendingEvents();
+
 	if(_quitInput->justPressed()) {
 		quit();
 	}
 
+	if(_profileInput->justPressed() && !_headless)
+		_profileLabel->setEnabled(!_profileLabel->enabled());
+	if(_profileDumpInput->justPressed()) {
+		const String& path = game()->config().profilePath;
+		dumpProfile(path.empty()? String("profile.csv"): path);
+	}
+
 #ifndef NDEBUG
 	if(_upInput->isPressed())
 		setMoney(_money + 5);
@@ -706,41 +1087,17 @@ void MainState::updateTick() {
 		if(_basketInput->justPressed())
 			_gameView->createToy(_basketModel);
 
-		_kittens.update();
-		_toys.update();
-
-		int nKittens = _spawnCount - _deathCount;
-
-		_kittenProgress += (0.25 + 0.75 * _happiness) * (1 + nKittens / 10.)
-		                   / KITTEN_TIME * TICK_LENGTH_IN_SEC;
-		if(_kittenProgress >= 1) {
-			spawnKitten();
-			_kittenProgress -= 1;
-		}
-
-		_payProgress += .2 * ceil(nKittens/10) * _happiness * TICK_LENGTH_IN_SEC;
-		if(_payProgress >= 1) {
-			setMoney(_money + 1);
-			_payProgress -= 1;
+		{
+			ProfileScope profile(_profiler, PROF_KITTENS);
+			_kittens.beginUpdate();
+			if(!_simThread.isStarted())
+				_kittens.runUpdate();
 		}
 
-		_happiness += TICK_LENGTH_IN_SEC / 300.0f;
-		if(_happiness > 1)
-			_happiness = 1;
-		setHappiness(_happiness);
-
-		for(KittenComponent& kitten: _kittens) {
-			EntityRef entity = kitten.entity();
-			Vector3 p = entity.position3();
-			p(2) = (1 - (p(1) / 1080)) / 10;
-			entity.moveTo(p);
-		}
-
-		_entities.updateWorldTransforms();
-		_collisions.findCollisions();
-
-		// FIXME: Might be useless...
-		updateTriggers();
+		if(_simThread.isStarted())
+			_kittensPending = true;
+		else
+			endPlayTick();
 	}
 	else if(_state == STATE_PAUSE) {
 //		if(_okInput->justPressed()) {
@@ -749,16 +1106,90 @@ void MainState::updateTick() {
 //		}
 	}
 
-	_entities.updateWorldTransforms();
+	{
+		ProfileScope profile(_profiler, PROF_WORLD_TRANSFORMS);
+		_entities.updateWorldTransforms();
+	}
+
+	// Kittens only write to their components and read the positions taken
+	// by beginUpdate(), never the entities, so they can be updated while
+	// frames render. Everything else waits for the next tick. The profiler
+	// is not thread-safe, so the task only records its time.
+	if(_kittensPending) {
+		_simThread.run([this] {
+			Profiler::Clock::time_point start = Profiler::Clock::now();
+			_kittens.runUpdate();
+			_kittensBackgroundNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			                           Profiler::Clock::now() - start).count();
+		});
+	}
 }
 
 
-void MainState::updateFrame() {
-	// Update camera
+void MainState::endPlayTick() {
+	{
+		ProfileScope profile(_profiler, PROF_KITTENS);
+		_kittens.endUpdate();
+	}
+	{
+		ProfileScope profile(_profiler, PROF_TOYS);
+		_toys.update();
+	}
+
+	int nKittens = _spawnCount - _deathCount;
+
+	_kittenProgress += (0.25 + 0.75 * _happiness) * (1 + nKittens / 10.)
+	                   / KITTEN_TIME * TICK_LENGTH_IN_SEC;
+	if(_kittenProgress >= 1) {
+		spawnKitten();
+		_kittenProgress -= 1;
+	}
+	++_colonyTicks;
+	retireCorpses();
+	_kittenPool.refill();
+
+	_payProgress += .2 * ceil(nKittens/10) * _happiness * TICK_LENGTH_IN_SEC;
+	if(_payProgress >= 1) {
+		setMoney(_money + 1);
+		_payProgress -= 1;
+	}
+
+	setHappiness(std::min(_happiness + TICK_LENGTH_IN_SEC / 300.0f, 1.0f));
+
+	for(KittenComponent& kitten: _kittens) {
+		EntityRef entity = kitten.entity();
+		Vector3 p = entity.position3();
+		p(2) = (1 - (p(1) / 1080)) / 10;
+		entity.moveTo(p);
+	}
+
+	{
+		ProfileScope profile(_profiler, PROF_WORLD_TRANSFORMS);
+		_entities.updateWorldTransforms();
+	}
+	{
+		ProfileScope profile(_profiler, PROF_COLLISIONS);
+		_collisions.findCollisions();
+	}
+	checkHitEvents();
 
+	updateTriggers();
+}
+
+
+void MainState::updateCamera() {
 	Vector3 pos(0, -42, 0);
 	Box3 viewBox(pos, pos + Vector3(1920, 1080, 1));
 	_camera.setViewBox(viewBox);
+	_gameView->updateViewTransform();
+}
+
+
+void MainState::updateFrame() {
+	_profiler.startFrame();
+	ProfileScope profileFrame(_profiler, PROF_FRAME);
+
+	updateCamera();
 
 	// Rendering
 	Context* glc = renderer()->context();
@@ -778,13 +1209,25 @@ void MainState::updateFrame() {
 
 		_spriteRenderer.beginRender();
 
-		_sprites.render(_entities.root(), _loop.frameInterp(), _camera);
-		_texts.render(_entities.root(), _loop.frameInterp(), _camera);
-		_tileLayers.render(_entities.root(), _loop.frameInterp(), _camera);
+		{
+			ProfileScope profile(_profiler, PROF_RENDER_SPRITES);
+			_sprites.render(_entities.root(), _loop.frameInterp(), _camera);
+		}
+		{
+			ProfileScope profile(_profiler, PROF_RENDER_TEXTS);
+			_texts.render(_entities.root(), _loop.frameInterp(), _camera);
+		}
+		{
+			ProfileScope profile(_profiler, PROF_RENDER_TILES);
+			_tileLayers.render(_entities.root(), _loop.frameInterp(), _camera);
+		}
 
 		OrthographicCamera guiCamera;
 		guiCamera.setViewBox(Box3(Vector3(0, 0, 0), Vector3(1920, 1080, 1)));
-		_gui.render(_guiPass, guiCamera.transform());
+		{
+			ProfileScope profile(_profiler, PROF_RENDER_GUI);
+			_gui.render(_guiPass, guiCamera.transform());
+		}
 
 		buffersFilled = _spriteRenderer.endRender();
 	}
@@ -796,14 +1239,21 @@ void MainState::updateFrame() {
 	glc->enable(gl::DEPTH_TEST);
 
 
-	window()->swapBuffers();
+	{
+		ProfileScope profile(_profiler, PROF_SWAP_BUFFERS);
+		window()->swapBuffers();
+	}
 //	glc->setLogCalls(true);
 
 	int64 now = int64(sys()->getTimeNs());
 	++_fpsCount;
 	int64 etime = now - _fpsTime;
 	if(etime >= ONE_SEC) {
-		log().info("Fps: ", _fpsCount * float(ONE_SEC) / etime);
+		float fps = _fpsCount * float(ONE_SEC) / etime;
+		log().info("Fps: ", fps, ", GUI draw calls: ", _gui.nDrawCalls(),
+		           " (", _gui.nWidgetDraws(), " widget draws)");
+		if(_profileLabel->enabled())
+			updateProfileLabel(fps);
 		_fpsTime  = now;
 		_fpsCount = 0;
 	}
@@ -816,12 +1266,33 @@ void MainState::resizeEvent() {
 	             Vector3(window()->width(),
 	                     window()->height(), 1));
 	_camera.setViewBox(viewBox);
+	_gameView->updateViewTransform();
 
 	_gui.setRealScreenSize(Vector2(window()->width(), window()->height()));
 	_gameView->resize(Vector2(window()->width(), window()->height()));
 }
 
 
+void MainState::updateProfileLabel(float fps) {
+	_profileLabel->setText(cat("Fps: ", std::round(fps), " (min / avg / p99)\n",
+	                           _profiler.report()));
+	_profileLabel->resizeToText();
+	_profileLabel->place(Vector2(16, 1080 - 16 - _profileLabel->size()(1)));
+}
+
+
+bool MainState::dumpProfile(const Path& path) {
+	Path::OStream out(path.native().c_str());
+	if(!out.good()) {
+		log().error("Unable to write profile to \"", path, "\".");
+		return false;
+	}
+	_profiler.writeCsv(out);
+	log().info("Profile written to \"", path, "\".");
+	return true;
+}
+
+
 bool MainState::loadEntities(const Path& path, EntityRef parent, const Path& cd) {
 	Path localPath = makeAbsolute(cd, path);
 	log().info("Load entity \"", localPath, "\"");
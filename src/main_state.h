@@ -42,7 +42,12 @@
 
 #include "ui/gui.h"
 
+#include "command.h"
 #include "components.h"
+#include "entity_pool.h"
+#include "observable.h"
+#include "profiler.h"
+#include "worker_pool.h"
 
 
 using namespace lair;
@@ -69,14 +74,30 @@ extern const float TICK_LENGTH_IN_SEC;
 extern const float FADE_DURATION;
 extern const float KITTEN_TIME;
 
-typedef int (*Command)(MainState* state, EntityRef self, int argc, const char** argv);
-typedef std::unordered_map<std::string, Command> CommandMap;
+// A kitten inside a trigger. Ids are TriggerComponent::occupancyId and
+// KittenComponent::occupancyId, which do not change when components move.
+struct TriggerOccupant {
+	unsigned  trigger;
+	unsigned  kitten;
+	EntityRef triggerEntity;
+	EntityRef kittenEntity;
+
+	bool operator<(const TriggerOccupant& other) const {
+		return trigger < other.trigger
+		    || (trigger == other.trigger && kitten < other.kitten);
+	}
+	bool operator==(const TriggerOccupant& other) const {
+		return trigger == other.trigger && kitten == other.kitten;
+	}
+};
+typedef std::vector<TriggerOccupant> TriggerOccupantVector;
 
-struct CommandExpr {
-	String    command;
-	EntityRef self;
+// A dead kitten and the colony tick at which it is removed.
+struct Corpse {
+	EntityRef kitten;
+	uint64    retireTick;
 };
-typedef std::deque<CommandExpr> CommandList;
+typedef std::deque<Corpse> CorpseQueue;
 
 
 enum State {
@@ -96,6 +117,8 @@ public:
 	virtual void run();
 	virtual void quit();
 
+	void runHeadless();
+
 	Game* game();
 
 	void exec(const std::string& cmd, EntityRef self = EntityRef());
@@ -104,6 +127,12 @@ public:
 	int execSingle(const std::string& cmd, EntityRef self = EntityRef());
 	int exec(int argc, const char** argv, EntityRef self = EntityRef());
 
+	// Commands must be registered before compiling the programs that use them.
+	CommandProgramSP compile(const std::string& cmds) const;
+	const CommandProgramSP& compiled(CommandProgramSP& cache, const std::string& cmds) const;
+	void exec(const CommandProgramSP& program, EntityRef self = EntityRef());
+	int execCall(const CommandProgram& program, unsigned call, EntityRef self);
+
 	void setLevel(const Path& level);
 	LevelSP registerLevel(const Path& level);
 	void loadLevel(const Path& level);
@@ -120,6 +149,7 @@ public:
 	EntityRef createTrigger(EntityRef parent, const char* name, const AlignedBox2& box);
 
 	void updateTriggers(bool disableCmds = false);
+	void triggerEvent(const TriggerOccupant& occupant, bool enter, bool disableCmds);
 
 	void showDialog(const String& message, const String& buttonText = "Continue",
 	                State state = STATE_PAUSE);
@@ -130,13 +160,32 @@ public:
 	void setSpawnDeath(int spawn, int death);
 
 	EntityRef spawnKitten(const Vector2& pos = Vector2(-1, -1));
+	// Place a copy of a toy model for free, as if dropped by the player.
+	// Returns an invalid ref if pos is blocked.
+	EntityRef placeToy(EntityRef model, const Vector2& pos);
+	// Unplaced toy from the pool of model, and back.
+	EntityRef createToy(EntityRef model);
+	void recycleToy(EntityRef toy);
+	// Dead kittens go back to the pool after GameConfig::corpseTime.
+	void addCorpse(EntityRef kitten);
+	void retireCorpses();
+	// Debug builds check that no disabled entity, like a retired corpse,
+	// shows up in the hit events of the last findCollisions().
+	void checkHitEvents();
 
 	void startGame();
 	void updateTick();
+	void endPlayTick();
+	// Also sets up screen to scene unprojection, so input handled before the
+	// first frame lands in the right place.
+	void updateCamera();
 	void updateFrame();
 
 	void resizeEvent();
 
+	void updateProfileLabel(float fps);
+	bool dumpProfile(const Path& path);
+
 	bool loadEntities(const Path& path, EntityRef parent = EntityRef(),
 	                  const Path& cd = Path());
 
@@ -167,13 +216,28 @@ public:
 
 	bool        _initialized;
 	bool        _running;
+	bool        _headless;
 	InterpLoop  _loop;
+	uint64      _tickCount;
+	uint64      _seed;
+	Rng         _rng;
+	WorkerPool  _workers;
+	BackgroundThread _simThread;
+	bool        _kittensPending;
+	// Time of the last background runUpdate(), read after _simThread.wait().
+	int64       _kittensBackgroundNs;
+	Profiler    _profiler;
 	int64       _fpsTime;
 	unsigned    _fpsCount;
 
 	CommandMap  _commands;
 	CommandList _commandList;
 
+	// Sorted. _triggerHits is rebuilt from the hit events of each tick.
+	TriggerOccupantVector _triggerOccupants;
+	TriggerOccupantVector _triggerHits;
+	unsigned              _nextOccupancyId;
+
 	Input*      _quitInput;
 	Input*      _leftInput;
 	Input*      _rightInput;
@@ -185,14 +249,23 @@ public:
 	Input*      _litterInput;
 	Input*      _medecineInput;
 	Input*      _basketInput;
+	Input*      _profileInput;
+	Input*      _profileDumpInput;
 
 	State    _state;
-	float    _happiness;
-	int      _money;
-	int      _spawnCount;
-	int      _deathCount;
+	// Watched by the HUD, change them with the setters below.
+	Observable<float> _happiness;
+	Observable<int>   _money;
+	int               _spawnCount;
+	int               _deathCount;
+	// Alive and dead kittens, derived from the two above in one go so that
+	// the HUD never sees half of a change.
+	Observable<Vector2i> _catCounts;
 	float    _kittenProgress;
 	float    _payProgress;
+	// Ticks spent in STATE_PLAY since the level was loaded.
+	uint64      _colonyTicks;
+	CorpseQueue _corpses;
 
 	LevelMap _levelMap;
 	LevelSP  _level;
@@ -212,6 +285,7 @@ public:
 	Widget*     _dialog;
 	Label*      _dialogText;
 	Label*      _dialogButton;
+	Label*      _profileLabel;
 
 	EntityRef   _models;
 	EntityRef   _kittenModel;
@@ -225,6 +299,9 @@ public:
 	EntityRef   _scene;
 	EntityRef   _toyLayer;
 	EntityRef   _kittenLayer;
+
+	EntityPool  _kittenPool;
+	EntityPool  _toyPools[TOY_TYPE_COUNT];
 };
 
 
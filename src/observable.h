@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_OBSERVABLE_H_
+#define KITTEN_KEEPER_OBSERVABLE_H_
+
+
+#include <functional>
+#include <vector>
+
+
+// A game value shown by the HUD. Each subscriber gives a key function,
+// typically what it displays (the rounded value, whether something is
+// affordable, ...), and is only called back when that key changes.
+template<typename T>
+class Observable {
+public:
+	typedef std::function<void(const T&)> Callback;
+
+public:
+	Observable(const T& value = T())
+	    : _value(value) {
+	}
+
+	Observable(const Observable&) = delete;
+	Observable(Observable&&)      = delete;
+	~Observable() = default;
+
+	Observable& operator=(const Observable&) = delete;
+	Observable& operator=(Observable&&)      = delete;
+
+	const T& get() const { return _value; }
+	operator const T&() const { return _value; }
+
+	void set(const T& value) {
+		_value = value;
+		for(Subscriber& sub: _subscribers) {
+			if(sub.keyChanged(_value))
+				sub.callback(_value);
+		}
+	}
+
+	// Call callback now, then every time key(value) changes.
+	template<typename Key>
+	void subscribe(Key key, const Callback& callback) {
+		auto last = key(_value);
+		_subscribers.push_back(Subscriber{
+			[key, last](const T& value) mutable {
+				auto k = key(value);
+				if(k == last)
+					return false;
+				last = k;
+				return true;
+			},
+			callback
+		});
+		callback(_value);
+	}
+
+	void subscribe(const Callback& callback) {
+		subscribe([](const T& value) { return value; }, callback);
+	}
+
+protected:
+	struct Subscriber {
+		std::function<bool(const T&)> keyChanged;
+		Callback                      callback;
+	};
+
+protected:
+	T                       _value;
+	std::vector<Subscriber> _subscribers;
+};
+
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+#include <cstdio>
+
+#include "profiler.h"
+
+
+namespace {
+
+struct CounterInfo {
+	const char* name;
+	bool        frame;
+};
+
+const CounterInfo counterInfo[PROF_COUNT] = {
+	{ "tick",             false },
+	{ "kittens",          false },
+	{ "kittens_wait",     false },
+	{ "toys",             false },
+	{ "world_transforms", false },
+	{ "collisions",       false },
+
+	{ "frame",            true  },
+	{ "render_sprites",   true  },
+	{ "render_texts",     true  },
+	{ "render_tiles",     true  },
+	{ "render_gui",       true  },
+	{ "swap_buffers",     true  },
+};
+
+}
+
+
+Profiler::Profiler(unsigned historySize)
+    : _historySize(std::max(historySize, 1u))
+{
+	clear();
+}
+
+
+const char* Profiler::name(ProfileCounter counter) {
+	return counterInfo[counter].name;
+}
+
+
+bool Profiler::isFrameCounter(ProfileCounter counter) {
+	return counterInfo[counter].frame;
+}
+
+
+void Profiler::startTick() {
+	commit(false);
+}
+
+
+void Profiler::startFrame() {
+	commit(true);
+}
+
+
+void Profiler::clear() {
+	for(unsigned ci = 0; ci < PROF_COUNT; ++ci) {
+		_pending[ci] = 0;
+		_hit[ci]     = false;
+		_samples[ci].clear();
+		_samples[ci].reserve(_historySize);
+		_next[ci]    = 0;
+	}
+}
+
+
+Profiler::Stats Profiler::stats(ProfileCounter counter) const {
+	const std::vector<int64>& samples = _samples[counter];
+
+	Stats stats = { unsigned(samples.size()), 0, 0, 0, 0 };
+	if(samples.empty())
+		return stats;
+
+	std::vector<int64> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	int64 sum = 0;
+	for(int64 s: sorted)
+		sum += s;
+
+	stats.min = sorted.front();
+	stats.avg = sum / int64(sorted.size());
+	stats.p99 = sorted[(sorted.size() - 1) * 99 / 100];
+	stats.max = sorted.back();
+
+	return stats;
+}
+
+
+String Profiler::report() const {
+	String report;
+	char line[128];
+	for(unsigned ci = 0; ci < PROF_COUNT; ++ci) {
+		ProfileCounter counter = ProfileCounter(ci);
+		Stats s = stats(counter);
+		if(!s.nSamples)
+			continue;
+		std::snprintf(line, sizeof(line), "%s%s: %.2f / %.2f / %.2f ms\n",
+		              (ci == PROF_TICK || ci == PROF_FRAME)? "": "  ", name(counter),
+		              s.min / 1e6, s.avg / 1e6, s.p99 / 1e6);
+		report += line;
+	}
+	return report;
+}
+
+
+void Profiler::writeCsv(std::ostream& out) const {
+	out << "counter,kind,samples,min_us,avg_us,p99_us,max_us\n";
+	for(unsigned ci = 0; ci < PROF_COUNT; ++ci) {
+		ProfileCounter counter = ProfileCounter(ci);
+		Stats s = stats(counter);
+		out << name(counter) << ","
+		    << (isFrameCounter(counter)? "frame": "tick") << ","
+		    << s.nSamples << ","
+		    << s.min / 1000.0 << ","
+		    << s.avg / 1000.0 << ","
+		    << s.p99 / 1000.0 << ","
+		    << s.max / 1000.0 << "\n";
+	}
+}
+
+
+void Profiler::commit(bool frame) {
+	for(unsigned ci = 0; ci < PROF_COUNT; ++ci) {
+		if(counterInfo[ci].frame != frame || !_hit[ci])
+			continue;
+
+		std::vector<int64>& samples = _samples[ci];
+		if(samples.size() < _historySize)
+			samples.push_back(_pending[ci]);
+		else
+			samples[_next[ci]] = _pending[ci];
+		_next[ci] = (_next[ci] + 1) % _historySize;
+
+		_pending[ci] = 0;
+		_hit[ci]     = false;
+	}
+}
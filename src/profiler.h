@@ -0,0 +1,144 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_PROFILER_H_
+#define KITTEN_KEEPER_PROFILER_H_
+
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+enum ProfileCounter {
+	PROF_TICK,
+	PROF_KITTENS,
+	// Time the tick waited for the background kitten update. The rest of it
+	// overlapped rendering.
+	PROF_KITTENS_WAIT,
+	PROF_TOYS,
+	PROF_WORLD_TRANSFORMS,
+	PROF_COLLISIONS,
+
+	PROF_FRAME,
+	PROF_RENDER_SPRITES,
+	PROF_RENDER_TEXTS,
+	PROF_RENDER_TILES,
+	PROF_RENDER_GUI,
+	PROF_SWAP_BUFFERS,
+
+	PROF_COUNT,
+};
+
+
+// Keeps the last samples of a fixed set of timing counters. Time spent in
+// a counter is accumulated until the next startTick() / startFrame(), so a
+// counter entered several times (e.g. when the sprite buffers overflow)
+// reports its total cost. Counters not entered during a tick or frame do
+// not record a sample.
+class Profiler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Stats {
+		unsigned nSamples;
+		int64    min;
+		int64    avg;
+		int64    p99;
+		int64    max;
+	};
+
+public:
+	Profiler(unsigned historySize = 600);
+	Profiler(const Profiler&) = delete;
+	Profiler(Profiler&&)      = delete;
+	~Profiler() = default;
+
+	Profiler& operator=(const Profiler&) = delete;
+	Profiler& operator=(Profiler&&)      = delete;
+
+	static const char* name(ProfileCounter counter);
+	static bool isFrameCounter(ProfileCounter counter);
+
+	unsigned historySize() const { return _historySize; }
+
+	void add(ProfileCounter counter, int64 ns) {
+		_pending[counter] += ns;
+		_hit[counter]      = true;
+	}
+
+	// Record the samples of the previous tick / frame.
+	void startTick();
+	void startFrame();
+	void clear();
+
+	// Times are in nanoseconds.
+	Stats stats(ProfileCounter counter) const;
+
+	// One line per counter, for the overlay.
+	String report() const;
+	void writeCsv(std::ostream& out) const;
+
+protected:
+	void commit(bool frame);
+
+protected:
+	unsigned _historySize;
+
+	int64    _pending[PROF_COUNT];
+	bool     _hit[PROF_COUNT];
+
+	// Ring buffers of the last _historySize samples.
+	std::vector<int64> _samples[PROF_COUNT];
+	unsigned           _next[PROF_COUNT];
+};
+
+
+// Adds the time between its construction and destruction to a counter.
+class ProfileScope {
+public:
+	ProfileScope(Profiler& profiler, ProfileCounter counter)
+	    : _profiler(profiler),
+	      _counter(counter),
+	      _start(Profiler::Clock::now()) {
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+	~ProfileScope() {
+		_profiler.add(_counter, std::chrono::duration_cast<std::chrono::nanoseconds>(
+		                  Profiler::Clock::now() - _start).count());
+	}
+
+protected:
+	Profiler&                   _profiler;
+	ProfileCounter              _counter;
+	Profiler::Clock::time_point _start;
+};
+
+
+#endif
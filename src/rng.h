@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_RNG_H_
+#define KITTEN_KEEPER_RNG_H_
+
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// xoshiro128** seeded with splitmix64. Small enough to give one to every
+// entity that needs randomness, so that they don't share any state.
+class Rng {
+public:
+	explicit Rng(uint64 seed = 0) {
+		setSeed(seed);
+	}
+
+	void setSeed(uint64 seed) {
+		for(unsigned i = 0; i < 2; ++i) {
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64 z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			z =  z ^ (z >> 31);
+			_s[2*i]     = uint32(z);
+			_s[2*i + 1] = uint32(z >> 32);
+		}
+	}
+
+	uint32 next() {
+		uint32 result = rotl(_s[1] * 5, 7) * 9;
+		uint32 t = _s[1] << 9;
+		_s[2] ^= _s[0];
+		_s[3] ^= _s[1];
+		_s[1] ^= _s[2];
+		_s[0] ^= _s[3];
+		_s[2] ^= t;
+		_s[3] = rotl(_s[3], 11);
+		return result;
+	}
+
+	// A seed for a new, independent stream.
+	uint64 nextSeed() {
+		// Two statements, the order of evaluation of operands is unspecified.
+		uint64 hi = next();
+		uint64 lo = next();
+		return (hi << 32) | lo;
+	}
+
+	// In [0, n).
+	unsigned below(unsigned n) {
+		return (uint64(next()) * n) >> 32;
+	}
+
+	bool oneIn(unsigned n) {
+		return below(n) == 0;
+	}
+
+	// In [0, 1).
+	float uniform() {
+		return (next() >> 8) * (1.f / (1u << 24));
+	}
+
+	// In [-1, 1]², like Vector2::Random().
+	Vector2 vector2() {
+		float x = uniform();
+		float y = uniform();
+		return Vector2(x, y) * 2 - Vector2(1, 1);
+	}
+
+protected:
+	static inline uint32 rotl(uint32 x, int k) {
+		return (x << k) | (x >> (32 - k));
+	}
+
+protected:
+	uint32 _s[4];
+};
+
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cmath>
+
+#include "spatial_grid.h"
+
+
+SpatialGrid::SpatialGrid()
+    : _origin(0, 0)
+    , _cellSize(1)
+    , _invCellSize(1)
+    , _size(1, 1)
+    , _reachMin(0, 0)
+    , _reachMax(0, 0)
+{
+	_cellStart.assign(2, 0);
+}
+
+
+void SpatialGrid::setBounds(const AlignedBox2& bounds, float cellSize) {
+	_origin      = bounds.min();
+	_cellSize    = cellSize;
+	_invCellSize = 1.f / cellSize;
+	_size        = (bounds.sizes() * _invCellSize).array().ceil().cast<int>()
+	                   .max(1).matrix();
+}
+
+
+void SpatialGrid::clear() {
+	_items.clear();
+	_reachMin = Vector2(0, 0);
+	_reachMax = Vector2(0, 0);
+}
+
+
+void SpatialGrid::insert(unsigned id, const AlignedBox2& box) {
+	insert(id, box, box.center());
+}
+
+
+void SpatialGrid::insert(unsigned id, const AlignedBox2& box, const Vector2& point) {
+	_items.push_back(Item{ box, point, id });
+	_reachMin = _reachMin.cwiseMax(point - box.min());
+	_reachMax = _reachMax.cwiseMax(box.max() - point);
+}
+
+
+void SpatialGrid::build() {
+	unsigned nCells = _size(0) * _size(1);
+
+	// Counting sort of the items by cell.
+	_cellStart.assign(nCells + 1, 0);
+	_itemCells.resize(_items.size());
+	for(unsigned ii = 0; ii < _items.size(); ++ii) {
+		unsigned ci = cellIndex(_items[ii].point);
+		_itemCells[ii] = ci;
+		++_cellStart[ci + 1];
+	}
+
+	for(unsigned ci = 0; ci < nCells; ++ci)
+		_cellStart[ci + 1] += _cellStart[ci];
+
+	// Items keep their insertion order within a cell.
+	_sorted.resize(_items.size());
+	for(unsigned ii = 0; ii < _items.size(); ++ii) {
+		unsigned& next = _cellStart[_itemCells[ii]];
+		_sorted[next] = _items[ii];
+		++next;
+	}
+
+	// The loop above shifted every start to the next cell, shift back.
+	for(unsigned ci = nCells; ci > 0; --ci)
+		_cellStart[ci] = _cellStart[ci - 1];
+	_cellStart[0] = 0;
+}
+
+
+bool SpatialGrid::intersects(const AlignedBox2& box, unsigned ignoreId) const {
+	return find(box, ignoreId) != nullptr;
+}
+
+
+const SpatialGrid::Item* SpatialGrid::find(const AlignedBox2& box, unsigned ignoreId) const {
+	Vector2i begin = cell(box.min() - _reachMax);
+	Vector2i end   = cell(box.max() + _reachMin);
+	for(int y = begin(1); y <= end(1); ++y) {
+		for(int x = begin(0); x <= end(0); ++x) {
+			unsigned ci = y * _size(0) + x;
+			for(unsigned ii = _cellStart[ci]; ii < _cellStart[ci + 1]; ++ii) {
+				const Item& item = _sorted[ii];
+				if(item.id != ignoreId && item.box.intersects(box))
+					return &item;
+			}
+		}
+	}
+	return nullptr;
+}
+
+
+const SpatialGrid::Item* SpatialGrid::nearest(const Vector2& p, float range) const {
+	const Item* best = nullptr;
+	float bestDist = range;
+
+	Vector2i center = cell(p);
+	int maxRing = std::max(_size(0), _size(1));
+	for(int ring = 0; ring <= maxRing; ++ring) {
+		// Points in this ring are at least that far away.
+		if(ring > 0 && (ring - 1) * _cellSize >= bestDist)
+			break;
+
+		Vector2i begin = (center - Vector2i(ring, ring)).cwiseMax(Vector2i(0, 0));
+		Vector2i end   = (center + Vector2i(ring, ring)).cwiseMin(_size - Vector2i(1, 1));
+		for(int y = begin(1); y <= end(1); ++y) {
+			bool edgeRow = (std::abs(y - center(1)) == ring);
+			for(int x = begin(0); x <= end(0); ++x) {
+				if(!edgeRow && std::abs(x - center(0)) != ring)
+					continue;
+
+				unsigned ci = y * _size(0) + x;
+				for(unsigned ii = _cellStart[ci]; ii < _cellStart[ci + 1]; ++ii) {
+					const Item& item = _sorted[ii];
+					float dist = (item.point - p).norm();
+					if(dist < bestDist || (best && dist == bestDist && item.id < best->id)) {
+						best     = &item;
+						bestDist = dist;
+					}
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+
+Vector2i SpatialGrid::cell(const Vector2& p) const {
+	Vector2 c = ((p - _origin) * _invCellSize).array().floor().matrix();
+	return Vector2i(std::min(std::max(int(c(0)), 0), _size(0) - 1),
+	                std::min(std::max(int(c(1)), 0), _size(1) - 1));
+}
+
+
+unsigned SpatialGrid::cellIndex(const Vector2& p) const {
+	Vector2i c = cell(p);
+	return c(1) * _size(0) + c(0);
+}
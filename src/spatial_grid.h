@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef KITTEN_KEEPER_SPATIAL_GRID_H_
+#define KITTEN_KEEPER_SPATIAL_GRID_H_
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// Uniform grid of boxes, meant to be rebuilt from scratch every tick.
+//
+// Items are bucketed by a reference point (the center of their box unless
+// told otherwise), so each item is stored exactly once and queries are
+// read-only. Fill it with clear() / insert() / build(), then query.
+class SpatialGrid {
+public:
+	struct Item {
+		AlignedBox2 box;
+		Vector2     point;
+		unsigned    id;
+	};
+
+	enum {
+		NO_ITEM = unsigned(-1),
+	};
+
+public:
+	SpatialGrid();
+	SpatialGrid(const SpatialGrid&)  = delete;
+	SpatialGrid(      SpatialGrid&&) = default;
+	~SpatialGrid() = default;
+
+	SpatialGrid& operator=(const SpatialGrid&)  = delete;
+	SpatialGrid& operator=(      SpatialGrid&&) = default;
+
+	unsigned nItems() const { return _items.size(); }
+
+	void setBounds(const AlignedBox2& bounds, float cellSize);
+
+	void clear();
+	void insert(unsigned id, const AlignedBox2& box);
+	void insert(unsigned id, const AlignedBox2& box, const Vector2& point);
+	void build();
+
+	// Call f(item) for every item whose box intersects `box`.
+	template<typename F>
+	void forEach(const AlignedBox2& box, F f) const {
+		Vector2i begin = cell(box.min() - _reachMax);
+		Vector2i end   = cell(box.max() + _reachMin);
+		for(int y = begin(1); y <= end(1); ++y) {
+			for(int x = begin(0); x <= end(0); ++x) {
+				unsigned ci = y * _size(0) + x;
+				for(unsigned ii = _cellStart[ci]; ii < _cellStart[ci + 1]; ++ii) {
+					const Item& item = _sorted[ii];
+					if(item.box.intersects(box))
+						f(item);
+				}
+			}
+		}
+	}
+
+	bool intersects(const AlignedBox2& box, unsigned ignoreId = NO_ITEM) const;
+	// Some item whose box intersects `box`, always the same one for a given
+	// grid content, or nullptr.
+	const Item* find(const AlignedBox2& box, unsigned ignoreId = NO_ITEM) const;
+
+	// Closest item point strictly within range of p, ties go to the lowest id.
+	const Item* nearest(const Vector2& p, float range) const;
+
+protected:
+	Vector2i cell(const Vector2& p) const;
+	unsigned cellIndex(const Vector2& p) const;
+
+protected:
+	Vector2  _origin;
+	float    _cellSize;
+	float    _invCellSize;
+	Vector2i _size;
+
+	// How far item boxes extend below / above their point.
+	Vector2  _reachMin;
+	Vector2  _reachMax;
+
+	std::vector<Item>     _items;
+	std::vector<unsigned> _itemCells;
+	std::vector<unsigned> _cellStart;
+	std::vector<Item>     _sorted;
+};
+
+
+#endif
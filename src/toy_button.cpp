@@ -81,11 +81,8 @@ void ToyButton::layout() {
 	_tooltip->place(Vector2(0, 88));
 }
 
-void ToyButton::update() {
-	ToyComponent* toy = _mainState->_toys.get(_model);
-	int cost = toy? toy->cost: 10;
-
-	if(_mainState->_money < cost) {
+void ToyButton::setAffordable(bool affordable) {
+	if(!affordable) {
 		_picture->setPictureColor(srgba(.5, .5, .5, 1));
 	}
 	else {
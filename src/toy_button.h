@@ -41,7 +41,8 @@ public:
 	void setToyName(const lair::String& name);
 	void setDescription(const lair::String& description);
 
-	void update();
+	// Grays the button out when the player cannot buy the toy.
+	void setAffordable(bool affordable);
 
 	void layout();
 
@@ -21,6 +21,8 @@
 
 #include <lair/sys_sdl2/image_loader.h>
 
+#include "gui.h"
+
 #include "frame.h"
 
 
@@ -49,8 +51,17 @@ void Frame::setColor(const Vector4& color) {
 	_color = color;
 }
 
-void Frame::render(RenderPass& renderPass, SpriteRenderer* renderer,
+void Frame::render(RenderPass& renderPass, SpriteRenderer* renderer, Gui* gui,
                    const Matrix4& transform, const Box2& box, float depth) {
+	// The 9-slice is rebuilt on each call: SpriteRenderer refills its
+	// buffers every frame, so nothing is kept between frames but the index
+	// pattern below and the shader parameters shared by Gui.
+	static const unsigned char sliceIndices[] = {
+	     0,  1,  4,  4,  1,  5,    1,  2,  5,  5,  2,  6,    2,  3,  6,  6,  3,  7,
+	     4,  5,  8,  8,  5,  9,    5,  6,  9,  9,  6, 10,    6,  7, 10, 10,  7, 11,
+	     8,  9, 12, 12,  9, 13,    9, 10, 13, 13, 10, 14,   10, 11, 14, 14, 11, 15,
+	};
+
 	TextureSetCSP  textureSet = _textureSet;
 	if(!textureSet)
 		return;
@@ -90,17 +101,8 @@ void Frame::render(RenderPass& renderPass, SpriteRenderer* renderer,
 		}
 
 		unsigned firstIndex = renderer->indexCount();
-		for(unsigned y = 0; y < 3; ++y) {
-			for(unsigned x = 0; x < 3; ++x) {
-				unsigned i = firstVertex + 4 * y + x;
-				renderer->addIndex(i + 0);
-				renderer->addIndex(i + 1);
-				renderer->addIndex(i + 4);
-				renderer->addIndex(i + 4);
-				renderer->addIndex(i + 1);
-				renderer->addIndex(i + 5);
-			}
-		}
+		for(unsigned char i: sliceIndices)
+			renderer->addIndex(firstVertex + i);
 		unsigned indexCount = renderer->indexCount() - firstIndex;
 
 		RenderPass::DrawStates states;
@@ -111,9 +113,8 @@ void Frame::render(RenderPass& renderPass, SpriteRenderer* renderer,
 
 		Vector4i tileInfo;
 		tileInfo << 1, 1, texColor->width(), texColor->height();
-		const ShaderParameter* params = renderer->addShaderParameters(
-		            renderer->shader(), transform, 0, tileInfo);
+		const ShaderParameter* params = gui->shaderParameters(transform, tileInfo);
 
-		renderPass.addDrawCall(states, params, 1 - depth, firstIndex, indexCount);
+		gui->addDrawCall(renderPass, states, params, 1 - depth, firstIndex, indexCount);
 	}
 }
@@ -32,6 +32,7 @@
 #include <lair/ec/sprite_renderer.h>
 
 class Frame;
+class Gui;
 
 class Frame {
 public:
@@ -44,7 +45,7 @@ public:
 	void setTextureSet(lair::TextureSetCSP textureSet);
 	void setColor(const lair::Vector4& color);
 
-	void render(lair::RenderPass& renderPass, lair::SpriteRenderer* renderer,
+	void render(lair::RenderPass& renderPass, lair::SpriteRenderer* renderer, Gui* gui,
 	            const lair::Matrix4& transform, const lair::Box2& box, float depth);
 
 protected:
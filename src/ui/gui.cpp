@@ -18,6 +18,8 @@
  *
  */
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
 
 #include "widget.h"
@@ -38,6 +40,16 @@ Gui::Gui(SysModule* sys,
     , _mouseGrabWidget(nullptr)
     , _logicScreenSize(Vector2(1920, 1080))
     , _realScreenSize(Vector2(1920, 1080))
+    , _hitIndexDirty(true)
+    , _hitGridSize(Vector2i(16, 9))
+    , _batchPass(nullptr)
+    , _batchStates()
+    , _batchParams(nullptr)
+    , _batchDepth(0)
+    , _batchFirstIndex(0)
+    , _batchIndexCount(0)
+    , _nDrawCalls(0)
+    , _nWidgetDraws(0)
 {
 	using std::placeholders::_1;
 	_sys->onMouseMove    = std::bind(&Gui::dispatchMouseMoveEvent,   this, _1);
@@ -53,12 +65,14 @@ Gui::~Gui() {
 
 void Gui::addWidget(Widget* widget) {
 	_widgets.push_back(widget);
+	invalidateHitIndex();
 }
 
 void Gui::removeWidget(Widget* widget) {
 	auto it = std::find(_widgets.begin(), _widgets.end(), widget);
 	lairAssert(it != _widgets.end());
 	_widgets.erase(it);
+	invalidateHitIndex();
 }
 
 void Gui::preRender() {
@@ -68,23 +82,95 @@ void Gui::preRender() {
 }
 
 void Gui::render(lair::RenderPass& renderPass, const Matrix4& transform) {
+	// Parameters live in the buffers of the sprite renderer, which are reset
+	// before each render.
+	_params.clear();
+	_nDrawCalls   = 0;
+	_nWidgetDraws = 0;
+
 	for(Widget* widget: _widgets) {
 		widget->render(renderPass, _spriteRenderer, transform);
 	}
+
+	flushDrawCalls();
+}
+
+const ShaderParameter* Gui::shaderParameters(const Matrix4& transform, const Vector4i& tileInfo) {
+	for(const ParamsEntry& entry: _params) {
+		if(entry.tileInfo == tileInfo && entry.transform == transform)
+			return entry.params;
+	}
+
+	const ShaderParameter* params = _spriteRenderer->addShaderParameters(
+	            _spriteRenderer->shader(), transform, 0, tileInfo);
+	_params.push_back(ParamsEntry{ transform, tileInfo, params });
+	return params;
+}
+
+void Gui::addDrawCall(RenderPass& renderPass, const RenderPass::DrawStates& states,
+                      const ShaderParameter* params, float depth,
+                      unsigned firstIndex, unsigned indexCount) {
+	++_nWidgetDraws;
+
+	if(_batchPass == &renderPass
+	        && _batchParams == params
+	        && _batchFirstIndex + _batchIndexCount == firstIndex
+	        && _batchStates.shader       == states.shader
+	        && _batchStates.vertices     == states.vertices
+	        && _batchStates.textureSet   == states.textureSet
+	        && _batchStates.blendingMode == states.blendingMode) {
+		// Indices come in drawing order, so the merged draw keeps the order
+		// of the widgets. Its depth is the one of the first.
+		_batchIndexCount += indexCount;
+		return;
+	}
+
+	flushDrawCalls();
+
+	_batchPass       = &renderPass;
+	_batchStates     = states;
+	_batchParams     = params;
+	_batchDepth      = depth;
+	_batchFirstIndex = firstIndex;
+	_batchIndexCount = indexCount;
+}
+
+void Gui::flushDrawCalls() {
+	if(!_batchPass)
+		return;
+
+	_batchPass->addDrawCall(_batchStates, _batchParams, _batchDepth,
+	                        _batchFirstIndex, _batchIndexCount);
+	++_nDrawCalls;
+
+	_batchPass   = nullptr;
+	_batchStates = RenderPass::DrawStates();
+}
+
+unsigned Gui::nDrawCalls() const {
+	return _nDrawCalls;
+}
+
+unsigned Gui::nWidgetDraws() const {
+	return _nWidgetDraws;
 }
 
 Widget* Gui::widgetAt(const Vector2& position) const {
-	Widget* found = nullptr;
+	updateHitIndex();
 
 	// Keep the last one, i.e. the topmost.
-	for(Widget* widget: _widgets) {
-		if(widget->enabled()) {
-			Widget* f = widget->widgetAt(position);
-			if(f) found = f;
-		}
+	unsigned cell = hitCell(position);
+	for(unsigned i = _hitCellStart[cell + 1]; i > _hitCellStart[cell]; --i) {
+		const HitEntry& entry = _hitEntries[_hitCellEntries[i - 1]];
+		if(entry.box.contains(position))
+			return entry.widget;
 	}
 
-	return found;
+	return nullptr;
+}
+
+void Gui::invalidateHitIndex() {
+	_hitIndexDirty = true;
 }
 
 lair::Vector2 Gui::logicScreenSize() const {
@@ -93,6 +179,7 @@ lair::Vector2 Gui::logicScreenSize() const {
 
 void Gui::setLogicScreenSize(const Vector2& logicSize) {
 	_logicScreenSize = logicSize;
+	invalidateHitIndex();
 }
 
 void Gui::setRealScreenSize(const Vector2& realSize) {
@@ -119,9 +206,7 @@ void Gui::dispatchEvent(Event& event) {
 		auto mEvent = static_cast<MouseEvent&>(event);
 		const Vector2& position = mEvent.position();
 
-		for(Widget* w: _widgets) {
-			dispatchHoverEvent(w, position);
-		}
+		dispatchHoverEvents(position);
 
 		Widget* widget = _mouseGrabWidget;
 		if(widget) {
@@ -147,26 +232,116 @@ void Gui::dispatchEvent(Event& event) {
 	}
 }
 
-void Gui::dispatchHoverEvent(Widget* widget, const lair::Vector2& position) {
-	if(!widget->enabled())
+void Gui::dispatchHoverEvents(const lair::Vector2& position) {
+	updateHitIndex();
+
+	// Only the widgets that contain the old or the new position may see the
+	// mouse enter or leave. Merge the two cells to keep drawing order.
+	_hoverEntries.clear();
+	unsigned lastCell = hitCell(_lastMousePos);
+	unsigned cell     = hitCell(position);
+	unsigned i0 = _hitCellStart[lastCell];
+	unsigned i1 = _hitCellStart[cell];
+	unsigned end0 = _hitCellStart[lastCell + 1];
+	unsigned end1 = (cell != lastCell)? _hitCellStart[cell + 1]: i1;
+	while(i0 < end0 || i1 < end1) {
+		unsigned e0 = (i0 < end0)? _hitCellEntries[i0]: unsigned(-1);
+		unsigned e1 = (i1 < end1)? _hitCellEntries[i1]: unsigned(-1);
+		unsigned ei = std::min(e0, e1);
+		if(e0 == ei) ++i0;
+		if(e1 == ei) ++i1;
+
+		const HitEntry& entry = _hitEntries[ei];
+		bool wasInside = entry.box.contains(_lastMousePos);
+		bool isInside  = entry.box.contains(position);
+		if(wasInside != isInside)
+			_hoverEntries.push_back(entry);
+	}
+
+	// Handlers may change the layout, which rebuilds the index: work on a
+	// copy.
+	for(const HitEntry& entry: _hoverEntries) {
+		bool isInside = entry.box.contains(position);
+		HoverEvent hover(isInside? HoverEvent::ENTER: HoverEvent::LEAVE);
+		entry.widget->processEvent(hover);
+	}
+}
+
+void Gui::updateHitIndex() const {
+	if(!_hitIndexDirty)
 		return;
+	_hitIndexDirty = false;
 
-	Box2 box = widget->absoluteBox();
-	bool wasInside = box.contains(_lastMousePos);
-	bool isInside  = box.contains(position);
+	_hitEntries.clear();
+	for(Widget* widget: _widgets)
+		addHitEntries(widget);
+
+	// Counting sort of the entries in the cells they overlap.
+	unsigned nCells = _hitGridSize.prod();
+	_hitCellStart.assign(nCells + 1, 0);
+	_hitCellEntries.clear();
+	for(int pass = 0; pass < 2; ++pass) {
+		for(unsigned ei = 0; ei < _hitEntries.size(); ++ei) {
+			const Box2& box = _hitEntries[ei].box;
+			if(box.isEmpty())
+				continue;
+			unsigned c0 = hitCell(box.min());
+			unsigned c1 = hitCell(box.max());
+			for(unsigned y = c0 / _hitGridSize(0); y <= c1 / _hitGridSize(0); ++y) {
+				for(unsigned x = c0 % _hitGridSize(0); x <= c1 % _hitGridSize(0); ++x) {
+					unsigned c = x + y * _hitGridSize(0);
+					if(pass == 0)
+						++_hitCellStart[c + 1];
+					else
+						_hitCellEntries[_hitCellStart[c]++] = ei;
+				}
+			}
+		}
 
-	if(wasInside != isInside) {
-		HoverEvent hover(isInside? HoverEvent::ENTER: HoverEvent::LEAVE);
-		widget->processEvent(hover);
+		if(pass == 0) {
+			for(unsigned c = 0; c < nCells; ++c)
+				_hitCellStart[c + 1] += _hitCellStart[c];
+			_hitCellEntries.resize(_hitCellStart[nCells]);
+		}
+		else {
+			// Filling moved each start to the next cell's start.
+			for(unsigned c = nCells; c > 0; --c)
+				_hitCellStart[c] = _hitCellStart[c - 1];
+			_hitCellStart[0] = 0;
+		}
 	}
+}
+
+void Gui::addHitEntries(Widget* widget) const {
+	if(!widget->enabled())
+		return;
 
+	_hitEntries.push_back(HitEntry{ widget, widget->absoluteBox() });
 	for(Widget* child: widget->children())
-		dispatchHoverEvent(child, position);
+		addHitEntries(child);
+}
+
+unsigned Gui::hitCell(const Vector2& position) const {
+	// Positions outside of the screen go to the border cells.
+	Vector2 cell = position.cwiseQuotient(_logicScreenSize)
+	                       .cwiseProduct(_hitGridSize.cast<float>());
+	int x = std::max(0, std::min(int(std::floor(cell(0))), _hitGridSize(0) - 1));
+	int y = std::max(0, std::min(int(std::floor(cell(1))), _hitGridSize(1) - 1));
+	return x + y * _hitGridSize(0);
+}
+
+void Gui::dispatchPendingEvents() {
+	for(MouseEvent& event: _pendingEvents)
+		dispatchEvent(event);
+	_pendingEvents.clear();
 }
 
 void Gui::dispatchMouseMoveEvent(const SDL_MouseMotionEvent& event) {
 	MouseEvent e(MouseEvent::MOUSE_MOVE, screenFromReal(event.x, event.y), 0);
-	dispatchEvent(e);
+	if(!_pendingEvents.empty() && _pendingEvents.back().mouseType() == MouseEvent::MOUSE_MOVE)
+		_pendingEvents.back() = e;
+	else
+		_pendingEvents.push_back(e);
 }
 
 void Gui::dispatchMouseButtonEvent(const SDL_MouseButtonEvent& event) {
@@ -181,8 +356,7 @@ void Gui::dispatchMouseButtonEvent(const SDL_MouseButtonEvent& event) {
 	MouseEvent::MouseType type = (event.type == SDL_MOUSEBUTTONDOWN)?
 	                                 MouseEvent::MOUSE_DOWN: MouseEvent::MOUSE_UP;
 
-	MouseEvent e(type, screenFromReal(event.x, event.y), button);
-	dispatchEvent(e);
+	_pendingEvents.push_back(MouseEvent(type, screenFromReal(event.x, event.y), button));
 }
 
 void Gui::dispatchMouseWheelEvent(const SDL_MouseWheelEvent& /*event*/) {
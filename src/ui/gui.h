@@ -22,6 +22,8 @@
 #ifndef LD_40_UI_GUI_H_
 #define LD_40_UI_GUI_H_
 
+#include <vector>
+
 #include <lair/core/lair.h>
 #include <lair/core/asset_manager.h>
 #include <lair/core/loader.h>
@@ -57,8 +59,29 @@ public:
 	void preRender();
 	void render(lair::RenderPass& renderPass, const lair::Matrix4& transform);
 
+	// Sprite shader parameters for widgets, shared by all the draw calls of
+	// a render() that use the same transform and tile info.
+	const lair::ShaderParameter* shaderParameters(const lair::Matrix4& transform,
+	                                              const lair::Vector4i& tileInfo);
+
+	// Widgets draw through these: consecutive draws with the same states and
+	// parameters over contiguous indices are merged in a single draw call.
+	// Flush before drawing anything directly in the render pass.
+	void addDrawCall(lair::RenderPass& renderPass, const lair::RenderPass::DrawStates& states,
+	                 const lair::ShaderParameter* params, float depth,
+	                 unsigned firstIndex, unsigned indexCount);
+	void flushDrawCalls();
+
+	// Draw calls issued by the last render(), and how many widget draws they
+	// stand for.
+	unsigned nDrawCalls() const;
+	unsigned nWidgetDraws() const;
+
 	Widget* widgetAt(const lair::Vector2& position) const;
 
+	// Called by widgets when their box, visibility or parent change.
+	void invalidateHitIndex();
+
 	lair::Vector2 logicScreenSize() const;
 
 	void setLogicScreenSize(const lair::Vector2& logicSize);
@@ -69,7 +92,11 @@ public:
 	void setMouseGrabWidget(Widget* widget);
 
 	void dispatchEvent(Event& event);
-	void dispatchHoverEvent(Widget* widget, const lair::Vector2& position);
+	void dispatchHoverEvents(const lair::Vector2& position);
+
+	// Mouse events are queued until the next call to dispatchPendingEvents(),
+	// and consecutive motions are coalesced: only the last one is dispatched.
+	void dispatchPendingEvents();
 
 	void dispatchMouseMoveEvent(const SDL_MouseMotionEvent& event);
 	void dispatchMouseButtonEvent(const SDL_MouseButtonEvent& event);
@@ -79,6 +106,17 @@ public:
 	lair::LoaderManager* loader();
 	lair::SpriteRenderer* spriteRenderer();
 
+protected:
+	struct HitEntry {
+		Widget*    widget;
+		lair::Box2 box;
+	};
+	typedef std::vector<HitEntry, Eigen::aligned_allocator<HitEntry>> HitEntryVector;
+
+	void updateHitIndex() const;
+	void addHitEntries(Widget* widget) const;
+	unsigned hitCell(const lair::Vector2& position) const;
+
 protected:
 	lair::SysModule*       _sys;
 	lair::AssetManager*    _assets;
@@ -89,9 +127,37 @@ protected:
 	lair::Vector2 _lastMousePos;
 	Widget*       _mouseWidget;
 	Widget*       _mouseGrabWidget;
+	std::vector<MouseEvent> _pendingEvents;
 
 	lair::Vector2 _logicScreenSize;
 	lair::Vector2 _realScreenSize;
+
+	// Enabled widgets in drawing order (parents before their children) with
+	// their absolute box, bucketed in a coarse grid over the logic screen.
+	// Each cell lists the entries overlapping it in increasing order, so the
+	// last one containing a point is the topmost widget. Rebuilt lazily.
+	mutable bool                  _hitIndexDirty;
+	mutable HitEntryVector        _hitEntries;
+	mutable std::vector<unsigned> _hitCellStart;
+	mutable std::vector<unsigned> _hitCellEntries;
+	lair::Vector2i                _hitGridSize;
+	HitEntryVector                _hoverEntries;
+
+	struct ParamsEntry {
+		lair::Matrix4                transform;
+		lair::Vector4i               tileInfo;
+		const lair::ShaderParameter* params;
+	};
+	std::vector<ParamsEntry, Eigen::aligned_allocator<ParamsEntry>> _params;
+
+	lair::RenderPass*            _batchPass;
+	lair::RenderPass::DrawStates _batchStates;
+	const lair::ShaderParameter* _batchParams;
+	float                        _batchDepth;
+	unsigned                     _batchFirstIndex;
+	unsigned                     _batchIndexCount;
+	unsigned                     _nDrawCalls;
+	unsigned                     _nWidgetDraws;
 };
 
 
@@ -88,6 +88,8 @@ float Label::render(lair::RenderPass& renderPass, lair::SpriteRenderer* renderer
 
 	Vector2 position = absolutePosition() + Vector2(_marginMin(0), -_marginMax(1));
 	position(1) += size()(1);
+	// Text is drawn directly in the render pass.
+	_gui->flushDrawCalls();
 	_textInfo.render(renderPass, renderer, _text, size()(0), position,
 	                 depth, transform);
 
@@ -115,10 +115,9 @@ float Picture::render(RenderPass& renderPass, SpriteRenderer* renderer,
 			states.blendingMode = _blendingMode;
 
 			Vector4i tileInfo(1, 1, tex.width(), tex.height());
-			const ShaderParameter* params = renderer->addShaderParameters(
-			            renderer->shader(), transform, 0, tileInfo);
+			const ShaderParameter* params = _gui->shaderParameters(transform, tileInfo);
 
-			renderPass.addDrawCall(states, params, 1 - depth, index, count);
+			_gui->addDrawCall(renderPass, states, params, 1 - depth, index, count);
 		}
 
 		depth += 1e-5;
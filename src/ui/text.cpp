@@ -30,9 +30,12 @@ using namespace lair;
 Text::Text(BitmapFontAspectSP font, const Vector4& color)
     : _font(font)
     , _color(color)
-    , _layout()
     , _anchor(0, 1)
     , _blendingMode(BLEND_ALPHA)
+    , _layoutFont(nullptr)
+    , _layoutText()
+    , _layoutWidth(0)
+    , _layout()
 {
 }
 
@@ -58,8 +61,7 @@ lair::Vector2 Text::textSize(const lair::String& text, int width) const {
 		return Vector2(0, 0);
 	const BitmapFont& font = fontAspect->get();
 
-	TextLayout layout = font.layoutText(text, width);
-	return layout.box().sizes();
+	return layout(font, text, width).box().sizes();
 }
 
 void Text::setFont(lair::BitmapFontAspectSP font) {
@@ -111,8 +113,16 @@ void Text::render(RenderPass& renderPass, SpriteRenderer* renderer,
 	transform(1, 3) -= (font.height() - font.glyph('O').size(1)) / 2;
 	transform(1, 3) = std::round(transform(1, 3));
 
-	TextLayout layout = font.layoutText(text, width);
-
 	renderBitmapText(&renderPass, renderer, font, textureSet, transform, 1 - depth,
-	                 layout, _anchor, _color, viewTransform, _blendingMode);
+	                 layout(font, text, width), _anchor, _color, viewTransform, _blendingMode);
+}
+
+const TextLayout& Text::layout(const BitmapFont& font, const String& text, int width) const {
+	if(&font != _layoutFont || width != _layoutWidth || text != _layoutText) {
+		_layout      = font.layoutText(text, width);
+		_layoutFont  = &font;
+		_layoutText  = text;
+		_layoutWidth = width;
+	}
+	return _layout;
 }
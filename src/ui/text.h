@@ -54,13 +54,23 @@ public:
 	            const lair::String& text, int width, const lair::Vector2& position,
 	            float depth, const lair::Matrix4& viewTransform);
 
+protected:
+	const lair::TextLayout& layout(const lair::BitmapFont& font,
+	                               const lair::String& text, int width) const;
+
 protected:
 	lair::BitmapFontAspectWP _font;
 	lair::TextureSetCSP      _textureSet;
 	lair::Vector4            _color;
-	lair::TextLayout         _layout;
 	lair::Vector2            _anchor;
 	lair::BlendingMode       _blendingMode;
+
+	// Last layout computed, reused while the text, width and font stay the
+	// same, which is the case of most labels from one frame to the next.
+	mutable const lair::BitmapFont* _layoutFont;
+	mutable lair::String            _layoutText;
+	mutable int                     _layoutWidth;
+	mutable lair::TextLayout        _layout;
 };
 
 
@@ -36,6 +36,8 @@ Widget::Widget(Gui* gui, Widget* parent)
     , _marginMin(Vector2(0, 0))
     , _marginMax(Vector2(0, 0))
     , _children ()
+    , _absolutePosition(Vector2(0, 0))
+    , _absolutePositionValid(false)
 {
 	lairAssert(_gui);
 
@@ -74,9 +76,13 @@ Vector2 Widget::position() const {
 }
 
 Vector2 Widget::absolutePosition() const {
-	if(_parent)
-		return _parent->absolutePosition() + position();
-	return position();
+	if(!_absolutePositionValid) {
+		_absolutePosition = position();
+		if(_parent)
+			_absolutePosition += _parent->absolutePosition();
+		_absolutePositionValid = true;
+	}
+	return _absolutePosition;
 }
 
 Vector2 Widget::size() const {
@@ -113,16 +119,21 @@ void Widget::setName(const String& name) {
 }
 
 void Widget::setEnabled(bool enabled) {
+	if(enabled != _enabled)
+		_gui->invalidateHitIndex();
 	_enabled = enabled;
 }
 
 void Widget::place(const lair::Vector2& position) {
 	_box.max() = position + _box.sizes();
 	_box.min() = position;
+	invalidateAbsolutePosition();
+	_gui->invalidateHitIndex();
 }
 
 void Widget::resize(const Vector2& size) {
 	_box.max() = _box.min() + size;
+	_gui->invalidateHitIndex();
 }
 
 void Widget::setMargin(float margin) {
@@ -174,6 +185,8 @@ void Widget::addChild(Widget* child) {
 
 	child->_parent = this;
 	_children.push_back(child);
+	child->invalidateAbsolutePosition();
+	_gui->invalidateHitIndex();
 }
 
 void Widget::removeChild(Widget* child) {
@@ -183,6 +196,8 @@ void Widget::removeChild(Widget* child) {
 	auto it = std::find(_children.begin(), _children.end(), child);
 	lairAssert(it != _children.end());
 	_children.erase(it);
+	child->invalidateAbsolutePosition();
+	_gui->invalidateHitIndex();
 }
 
 Box2 Widget::absoluteBox() const {
@@ -316,9 +331,17 @@ float Widget::render(lair::RenderPass& renderPass, SpriteRenderer* renderer,
 	return renderChildren(renderPass, renderer, transform, depth);
 }
 
+void Widget::invalidateAbsolutePosition() {
+	if(!_absolutePositionValid)
+		return;
+	_absolutePositionValid = false;
+	for(Widget* child: _children)
+		child->invalidateAbsolutePosition();
+}
+
 float Widget::renderFrame(lair::RenderPass& renderPass, lair::SpriteRenderer* renderer,
                           const lair::Matrix4& transform, float depth) {
-	_frame.render(renderPass, renderer, transform, absoluteBox(), depth);
+	_frame.render(renderPass, renderer, _gui, transform, absoluteBox(), depth);
 
 	return depth + 1e-5;
 }
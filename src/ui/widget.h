@@ -118,6 +118,8 @@ public:
 	std::function<void(Widget*, ResizeEvent&)> onResize;
 
 protected:
+	void invalidateAbsolutePosition();
+
 	float renderFrame(lair::RenderPass& renderPass, lair::SpriteRenderer* renderer,
 	                  const lair::Matrix4& transform, float depth);
 	float renderChildren(lair::RenderPass& renderPass, lair::SpriteRenderer* renderer,
@@ -133,6 +135,10 @@ protected:
 	lair::Vector2     _marginMax;
 	WidgetVector      _children;
 
+	// Cached by absolutePosition(). If valid, the parent's is valid too.
+	mutable lair::Vector2 _absolutePosition;
+	mutable bool          _absolutePositionValid;
+
 	Frame _frame;
 
 //	bool              _layoutDirty;
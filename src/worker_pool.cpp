@@ -0,0 +1,218 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <algorithm>
+
+#include "worker_pool.h"
+
+
+WorkerPool::WorkerPool()
+    : _quit(false)
+    , _generation(0)
+    , _task(nullptr)
+    , _count(0)
+    , _nChunks(0)
+    , _nextChunk(0)
+    , _pending(0)
+{
+}
+
+
+WorkerPool::~WorkerPool() {
+	stop();
+}
+
+
+unsigned WorkerPool::nThreads() const {
+	return _threads.size() + 1;
+}
+
+
+void WorkerPool::start(unsigned nThreads) {
+	stop();
+
+	if(nThreads == 0)
+		nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	_quit = false;
+	for(unsigned ti = 1; ti < nThreads; ++ti)
+		_threads.emplace_back(&WorkerPool::workerMain, this);
+}
+
+
+void WorkerPool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_startCond.notify_all();
+
+	for(std::thread& thread: _threads)
+		thread.join();
+	_threads.clear();
+}
+
+
+void WorkerPool::run(unsigned count, unsigned nChunks, const Task& task) {
+	nChunks = std::min(nChunks, count);
+	if(nChunks <= 1 || _threads.empty()) {
+		if(count)
+			task(0, count, 0);
+		return;
+	}
+
+	uint64 generation;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		generation = ++_generation;
+		_task      = &task;
+		_count     = count;
+		_nChunks   = nChunks;
+		_nextChunk = 0;
+		_pending   = nChunks;
+	}
+	_startCond.notify_all();
+
+	while(runChunk(generation));
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_doneCond.wait(lock, [this] { return _pending == 0; });
+	_task = nullptr;
+}
+
+
+bool WorkerPool::runChunk(uint64 generation) {
+	unsigned chunk;
+	unsigned begin;
+	unsigned end;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(_generation != generation || _nextChunk == _nChunks)
+			return false;
+		chunk = _nextChunk++;
+		begin = uint64(_count) *  chunk      / _nChunks;
+		end   = uint64(_count) * (chunk + 1) / _nChunks;
+	}
+
+	(*_task)(begin, end, chunk);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(--_pending == 0)
+		_doneCond.notify_all();
+	return true;
+}
+
+
+void WorkerPool::workerMain() {
+	uint64 generation = 0;
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_startCond.wait(lock, [&] { return _quit || _generation != generation; });
+			if(_quit)
+				return;
+			generation = _generation;
+		}
+
+		while(runChunk(generation));
+	}
+}
+
+
+BackgroundThread::BackgroundThread()
+    : _quit(false)
+    , _busy(false)
+{
+}
+
+
+BackgroundThread::~BackgroundThread() {
+	stop();
+}
+
+
+bool BackgroundThread::isStarted() const {
+	return _thread.joinable();
+}
+
+
+void BackgroundThread::start() {
+	stop();
+
+	_quit = false;
+	_thread = std::thread(&BackgroundThread::threadMain, this);
+}
+
+
+void BackgroundThread::stop() {
+	if(!_thread.joinable())
+		return;
+
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_startCond.notify_all();
+	_thread.join();
+}
+
+
+void BackgroundThread::run(const Task& task) {
+	if(!_thread.joinable()) {
+		task();
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_doneCond.wait(lock, [this] { return !_busy; });
+	_task = task;
+	_busy = true;
+	lock.unlock();
+	_startCond.notify_all();
+}
+
+
+void BackgroundThread::wait() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_doneCond.wait(lock, [this] { return !_busy; });
+}
+
+
+void BackgroundThread::threadMain() {
+	while(true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_startCond.wait(lock, [this] { return _quit || _busy; });
+			if(_quit)
+				return;
+			task = std::move(_task);
+		}
+
+		task();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_busy = false;
+		_doneCond.notify_all();
+	}
+}
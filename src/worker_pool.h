@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2017 the authors (see AUTHORS)
+ *
+ *  This file is part of Kitten Keeper.
+ *
+ *  Kitten Keeper is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Kitten Keeper is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Kitten Keeper.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef KITTEN_KEEPER_WORKER_POOL_H_
+#define KITTEN_KEEPER_WORKER_POOL_H_
+
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// Fixed set of threads that run the same task over chunks of a range. The
+// calling thread takes its share of the work, so nThreads() counts it.
+class WorkerPool {
+public:
+	typedef std::function<void(unsigned begin, unsigned end, unsigned chunk)> Task;
+
+public:
+	WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool(WorkerPool&&)      = delete;
+	~WorkerPool();
+
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	WorkerPool& operator=(WorkerPool&&)      = delete;
+
+	unsigned nThreads() const;
+
+	// 0 means one thread per core.
+	void start(unsigned nThreads);
+	void stop();
+
+	// Split [0, count) in nChunks contiguous ranges and call task on each of
+	// them. Returns once all the chunks are done.
+	void run(unsigned count, unsigned nChunks, const Task& task);
+
+protected:
+	bool runChunk(uint64 generation);
+	void workerMain();
+
+protected:
+	std::vector<std::thread> _threads;
+	std::mutex               _mutex;
+	std::condition_variable  _startCond;
+	std::condition_variable  _doneCond;
+	bool                     _quit;
+
+	// Current run, protected by _mutex.
+	uint64      _generation;
+	const Task* _task;
+	unsigned    _count;
+	unsigned    _nChunks;
+	unsigned    _nextChunk;
+	unsigned    _pending;
+};
+
+
+// A single thread that runs one task at a time while the caller does
+// something else. Without a thread, run() calls the task directly.
+class BackgroundThread {
+public:
+	typedef std::function<void()> Task;
+
+public:
+	BackgroundThread();
+	BackgroundThread(const BackgroundThread&) = delete;
+	BackgroundThread(BackgroundThread&&)      = delete;
+	~BackgroundThread();
+
+	BackgroundThread& operator=(const BackgroundThread&) = delete;
+	BackgroundThread& operator=(BackgroundThread&&)      = delete;
+
+	bool isStarted() const;
+
+	void start();
+	void stop();
+
+	// Wait for the previous task, then start this one.
+	void run(const Task& task);
+	// Returns once the last task is done.
+	void wait();
+
+protected:
+	void threadMain();
+
+protected:
+	std::thread             _thread;
+	std::mutex              _mutex;
+	std::condition_variable _startCond;
+	std::condition_variable _doneCond;
+	bool                    _quit;
+
+	// Protected by _mutex.
+	Task                    _task;
+	bool                    _busy;
+};
+
+
+#endif